@@ -5,7 +5,10 @@
 
 /**
  * 1. Create a guarded header that defines SKIPLIST_KEY and SKIPLIST_VALUE
- *    and includes skiplist.h. Optionally define SKIPLIST_NAMESPACE.
+ *    and includes skiplist.h. Optionally define SKIPLIST_NAMESPACE. Leave
+ *    out SKIPLIST_VALUE for a sorted set: nodes then hold no value, and
+ *    the value parameters, typed char, are ignored on the way in and 0 on
+ *    the way out.
  * 2. Define SKIPLIST_IMPLEMENTATION somewhere in your program above
  *    your custom header include.
  * 3. Repeat for any different key/value pair types you need. Be sure to
@@ -15,8 +18,102 @@
  *      - SKIPLIST_MAX_LEVELS - 33 by default
  *      - SKIPLIST_MALLOC & SKIPLIST_FREE - wrappers for stdlib malloc/free by default
  *        Both are passed a void * data pointer (for memory pool, gc context, etc).
- *      - SKIPLIST_RAND & SKIPLIST_SRAND - wrappers around stdlib rand/srand.
- *        Both are passed a void * pointer for a random context.
+ *      - SKIPLIST_RAND & SKIPLIST_SRAND - custom random number generator.
+ *        Both are passed a void * pointer for a random context. If
+ *        SKIPLIST_RAND is not defined, each list carries its own splitmix64
+ *        generator instead, so lists never share hidden RNG state.
+ *      - SKIPLIST_CMP(a, b, udata) - if defined, expanded in place of calls
+ *        to the comparator passed to init, so the compiler can inline it.
+ *        udata is the list's cmp_udata. init's cmp may then be NULL.
+ *      - SKIPLIST_KEY_BYTES(key, len) & SKIPLIST_KEY_LOAD(key, buf, len, udata)
+ *        - how serialize writes a key and deserialize reads it back.
+ *        SKIPLIST_KEY_BYTES evaluates to a pointer to the bytes to write
+ *        for `key` and stores their number in the size_t `len`.
+ *        SKIPLIST_KEY_LOAD sets `key` from the `len` bytes at `buf`,
+ *        `udata` being deserialize's, and evaluates to 0 on success. By
+ *        default a key's own bytes are written, which only suits plain
+ *        data read back on the same kind of machine.
+ *      - SKIPLIST_VALUE_BYTES(val, len) & SKIPLIST_VALUE_LOAD(val, buf, len,
+ *        udata) - the same for values.
+ *      - SKIPLIST_INT_KEYS - if defined, SKIPLIST_KEY is an integer type
+ *        ordered numerically. Keys are compared inline, ignoring the
+ *        comparator and SKIPLIST_CMP, and with SKIPLIST_FAT_NODES the
+ *        search inside a node counts the keys below the probe with
+ *        branch-free SSE2, SSE4.2 or AVX2 compares (whichever the compiler
+ *        targets) for 32 and 64-bit keys, or a scalar loop otherwise.
+ *      - SKIPLIST_NO_SIMD - if defined, always use the scalar loop.
+ *      - SKIPLIST_COLD_VALUES - if defined, each node's value is stored
+ *        after its links instead of next to its key, so searches only
+ *        touch the key and links. Worth it when SKIPLIST_VALUE is large.
+ *        Cannot be combined with SKIPLIST_FAT_NODES or
+ *        SKIPLIST_CONCURRENT.
+ *      - SKIPLIST_MULTI - if defined, a key may be inserted more than once.
+ *        insert adds the pair after any with an equal key, so ties keep
+ *        their insertion order, and count, find_all, remove_all and
+ *        equal_range are also provided. Cannot be combined with
+ *        SKIPLIST_FAT_NODES or SKIPLIST_CONCURRENT.
+ *      - SKIPLIST_INDEXED - if defined, every forward link also records how
+ *        many nodes it skips, which enables rank, at and remove_at in
+ *        O(log n) at the cost of one unsigned long per link.
+ *      - SKIPLIST_POOL - if defined, each list carves its nodes out of slabs
+ *        (one set per node height) and recycles freed nodes instead of
+ *        calling SKIPLIST_MALLOC and SKIPLIST_FREE for every node.
+ *      - SKIPLIST_POOL_SLAB - number of height 1 nodes per slab when
+ *        SKIPLIST_POOL is defined, 64 by default. Taller nodes get
+ *        proportionally smaller slabs.
+ *      - SKIPLIST_PERSIST - if defined, also provides open, sync and close,
+ *        which keep a list's nodes in a memory-mapped file so that it can
+ *        be opened again without rebuilding it, and shared read-only
+ *        between processes. Links hold offsets rather than pointers, so
+ *        following one costs an add. Needs POSIX mmap; merge and split
+ *        are not available, and it cannot be combined with SKIPLIST_CONCURRENT,
+ *        SKIPLIST_SWMR, SKIPLIST_FAT_NODES or SKIPLIST_POOL.
+ *      - SKIPLIST_FAT_NODES - if defined to a number K of at least 2, each
+ *        node holds up to K pairs in sorted arrays, like a skip list of
+ *        B-tree leaves, and the links only index each node's first key.
+ *        Nodes split when full and merge with their neighbour when both
+ *        fit in half a node, so lookups follow far fewer pointers and
+ *        iteration reads contiguous memory. Any insert or remove may
+ *        move other pairs, so it invalidates every cursor.
+ *        build_sorted, insert_sorted_batch, merge, erase_range, split,
+ *        intersect, union, difference and find_many are not available, and
+ *        it cannot be combined with SKIPLIST_INDEXED, SKIPLIST_CONCURRENT
+ *        or SKIPLIST_SWMR.
+ *      - SKIPLIST_CONCURRENT - if defined, the list may be used from many
+ *        threads at once without locking. Links become C11 atomics, so
+ *        this needs a C11 compiler with <stdatomic.h>, and only init, free,
+ *        insert, find, get, remove, iter, size, min and pop are available.
+ *        It cannot be combined with SKIPLIST_INDEXED or SKIPLIST_POOL.
+ *        Removed nodes are passed to SKIPLIST_FREE once no thread can
+ *        still be reading them, so SKIPLIST_MALLOC and SKIPLIST_FREE must
+ *        be thread-safe.
+ *      - SKIPLIST_SWMR - if defined, one writer thread may change the list
+ *        while any number of reader threads call find, get, find_many,
+ *        iter, iter_range, lower_bound, upper_bound, min and max without
+ *        locking, and may walk cursors either way between read_lock and
+ *        read_unlock. Every other function is for the writer only, and merge
+ *        must not run while readers use its source list. Removed nodes
+ *        are freed once no reader can see them, and overwritten values get
+ *        a fresh node instead of being changed in place. Needs C11
+ *        atomics.
+ *      - SKIPLIST_EPOCH_STRIPES - number of cache lines threads spread
+ *        their read announcements over when SKIPLIST_CONCURRENT or
+ *        SKIPLIST_SWMR is defined, 16 by default.
+ *      - SKIPLIST_SHARDED - if defined, also provides sharded_*, which
+ *        splits the key space over several independent lists, each behind
+ *        its own lock, so threads writing different shards never contend.
+ *        Cannot be combined with SKIPLIST_CONCURRENT.
+ *      - SKIPLIST_LOCK_TYPE, SKIPLIST_LOCK_INIT(l), SKIPLIST_LOCK_FREE(l),
+ *        SKIPLIST_LOCK(l) & SKIPLIST_UNLOCK(l) - the per-shard lock when
+ *        SKIPLIST_SHARDED is defined, a pthread mutex by default. Each is
+ *        passed a pointer to the lock; SKIPLIST_LOCK_INIT returns 0 on
+ *        success.
+ *      - SKIPLIST_STATS - if defined, each list counts calls to find,
+ *        insert, remove, pop and shift, key comparisons, nodes visited on
+ *        each level while searching, and node allocations and frees.
+ *        stats reports them along with the list's shape, and stats_reset
+ *        zeroes them. Without it the counting compiles to nothing. Cannot
+ *        be combined with SKIPLIST_CONCURRENT or SKIPLIST_SWMR.
  *      - SKIPLIST_STATIC - if defined, declare all public functions static
  *        (make skiplist local to the file it's included from).
  *      - SKIPLIST_EXTERN - 'extern' by default; define to change calling convention
@@ -93,6 +190,11 @@
  *     }
  */
 
+#ifdef SKIPLIST_IMPLEMENTATION
+#include <stddef.h>
+#include <string.h>
+#endif
+
 #ifndef SKIPLIST_MALLOC
 #ifdef SKIPLIST_IMPLEMENTATION
 #include <stdlib.h>
@@ -101,9 +203,13 @@
 #define SKIPLIST_FREE(udata, ptr) free((ptr))
 #endif
 
-#if !defined(SKIPLIST_KEY) || !defined(SKIPLIST_VALUE)
-#error Please define SKIPLIST_KEY and SKIPLIST_VALUE before including \
-this file. See the comments at the top for usage instructions.
+#ifndef SKIPLIST_KEY
+#error Please define SKIPLIST_KEY (and SKIPLIST_VALUE, unless you want a \
+set) before including this file. See the comments at the top for usage \
+instructions.
+#endif
+#ifndef SKIPLIST_VALUE
+#define SL_SET_
 #endif
 
 #ifndef SKIPLIST_NAMESPACE
@@ -120,6 +226,68 @@ this file. See the comments at the top for usage instructions.
 #define SKIPLIST_MAX_LEVELS 33
 #endif
 
+#if defined(SKIPLIST_CONCURRENT) || defined(SKIPLIST_SWMR)
+#if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L || defined(__STDC_NO_ATOMICS__)
+#error SKIPLIST_CONCURRENT and SKIPLIST_SWMR need a C11 compiler with <stdatomic.h>
+#endif
+#include <stdatomic.h>
+#ifndef SKIPLIST_EPOCH_STRIPES
+#define SKIPLIST_EPOCH_STRIPES 16
+#endif
+#define SL_EPOCHS_
+#endif
+#if defined(SKIPLIST_CONCURRENT) && \
+    (defined(SKIPLIST_INDEXED) || defined(SKIPLIST_POOL) || defined(SKIPLIST_SWMR))
+#error SKIPLIST_CONCURRENT cannot be combined with SKIPLIST_INDEXED, SKIPLIST_POOL or SKIPLIST_SWMR
+#endif
+
+#if defined(SKIPLIST_COLD_VALUES) && (defined(SKIPLIST_FAT_NODES) || defined(SKIPLIST_CONCURRENT) || defined(SL_SET_))
+#error SKIPLIST_COLD_VALUES cannot be combined with SKIPLIST_FAT_NODES or SKIPLIST_CONCURRENT, and needs SKIPLIST_VALUE
+#endif
+
+#ifdef SKIPLIST_PERSIST
+#if defined(SKIPLIST_CONCURRENT) || defined(SKIPLIST_SWMR) || defined(SKIPLIST_FAT_NODES) || defined(SKIPLIST_POOL)
+#error SKIPLIST_PERSIST cannot be combined with SKIPLIST_CONCURRENT, SKIPLIST_SWMR, SKIPLIST_FAT_NODES or SKIPLIST_POOL
+#endif
+#ifdef SKIPLIST_IMPLEMENTATION
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+#if defined(SKIPLIST_MULTI) && (defined(SKIPLIST_FAT_NODES) || defined(SKIPLIST_CONCURRENT))
+#error SKIPLIST_MULTI cannot be combined with SKIPLIST_FAT_NODES or SKIPLIST_CONCURRENT
+#endif
+
+#if defined(SKIPLIST_STATS) && (defined(SKIPLIST_CONCURRENT) || defined(SKIPLIST_SWMR))
+#error SKIPLIST_STATS cannot be combined with SKIPLIST_CONCURRENT or SKIPLIST_SWMR
+#endif
+
+#ifdef SKIPLIST_FAT_NODES
+#if SKIPLIST_FAT_NODES < 2
+#error SKIPLIST_FAT_NODES must be at least 2
+#endif
+#if defined(SKIPLIST_INDEXED) || defined(SKIPLIST_CONCURRENT) || defined(SKIPLIST_SWMR)
+#error SKIPLIST_FAT_NODES cannot be combined with SKIPLIST_INDEXED, SKIPLIST_CONCURRENT or SKIPLIST_SWMR
+#endif
+#endif
+
+#ifdef SKIPLIST_SHARDED
+#ifdef SKIPLIST_CONCURRENT
+#error SKIPLIST_SHARDED cannot be combined with SKIPLIST_CONCURRENT
+#endif
+#ifndef SKIPLIST_LOCK_TYPE
+#include <pthread.h>
+#define SKIPLIST_LOCK_TYPE pthread_mutex_t
+#define SKIPLIST_LOCK_INIT(l) pthread_mutex_init((l), NULL)
+#define SKIPLIST_LOCK_FREE(l) pthread_mutex_destroy((l))
+#define SKIPLIST_LOCK(l) pthread_mutex_lock((l))
+#define SKIPLIST_UNLOCK(l) pthread_mutex_unlock((l))
+#endif
+#endif
+
 #define SL_PASTE_(x,y) x ## y
 #define SL_CAT_(x,y) SL_PASTE_(x,y)
 #define SKIPLIST_NAME(name) SL_CAT_(SKIPLIST_NAMESPACE,name)
@@ -128,54 +296,432 @@ this file. See the comments at the top for usage instructions.
 #define SL_LIST SKIPLIST_NAME(skiplist)
 #define SL_CMP_FN SKIPLIST_NAME(cmp_fn)
 #define SL_ITER_FN SKIPLIST_NAME(iter_fn)
+#define SL_WRITE_FN SKIPLIST_NAME(write_fn)
+#define SL_READ_FN SKIPLIST_NAME(read_fn)
+#define SL_CURSOR SKIPLIST_NAME(cursor)
+#define SL_SHARDED SKIPLIST_NAME(sharded)
+#define SL_SPLIT_FN SKIPLIST_NAME(split_fn)
+#define SL_STATS SKIPLIST_NAME(statistics)
 #define SL_KEY SKIPLIST_KEY
+#ifdef SL_SET_
+#define SL_VAL char
+#else
 #define SL_VAL SKIPLIST_VALUE
+#endif
+
+/* Nodes are allocated with exactly as many forward pointers as their height.
+   C89 has no flexible array members, so fall back to the struct hack. */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#define SL_FLEX_
+#else
+#define SL_FLEX_ 1
+#endif
+/* Links, and the tail, are read and written through these so that
+   SKIPLIST_SWMR can make them atomic: writers publish with release stores
+   and readers follow links with acquire loads. */
+#ifdef SKIPLIST_SWMR
+#define SL_ATOMIC_ _Atomic
+#define SL_NEXT_(n, i) atomic_load_explicit(&(n)->next[i], memory_order_acquire)
+#define SL_SET_NEXT_(n, i, v) atomic_store_explicit(&(n)->next[i], (v), memory_order_release)
+#define SL_PREV_(n) atomic_load_explicit(&(n)->prev, memory_order_acquire)
+#define SL_SET_PREV_(n, v) atomic_store_explicit(&(n)->prev, (v), memory_order_release)
+#define SL_TAIL_(list) atomic_load_explicit(&(list)->tail, memory_order_acquire)
+#define SL_SET_TAIL_(list, v) atomic_store_explicit(&(list)->tail, (v), memory_order_release)
+#else
+#define SL_ATOMIC_
+#ifdef SKIPLIST_PERSIST
+/* A link holds the distance from itself to the node it points to, or 0 for
+   NULL, so a mapped file is valid wherever it lands in memory. */
+#define SL_NEXT_(n, i) SKIPLIST_NAME(_follow)(&(n)->next[i])
+#define SL_SET_NEXT_(n, i, v) SKIPLIST_NAME(_point)(&(n)->next[i], (v))
+#define SL_PREV_(n) SKIPLIST_NAME(_follow)(&(n)->prev)
+#define SL_SET_PREV_(n, v) SKIPLIST_NAME(_point)(&(n)->prev, (v))
+#else
+#define SL_NEXT_(n, i) ((n)->next[i])
+#define SL_SET_NEXT_(n, i, v) ((n)->next[i] = (v))
+#endif
+#endif
+#ifndef SL_PREV_
+#define SL_PREV_(n) ((n)->prev)
+#define SL_SET_PREV_(n, v) ((n)->prev = (v))
+#endif
+#ifndef SL_TAIL_
+#define SL_TAIL_(list) ((list)->tail)
+#define SL_SET_TAIL_(list, v) ((list)->tail = (v))
+#endif
+#ifdef SKIPLIST_PERSIST
+#define SL_LINK_ intptr_t
+#else
+#define SL_LINK_ SL_NODE *SL_ATOMIC_
+#endif
+#if defined(SKIPLIST_CONCURRENT)
+#define SL_NODE_SIZE(h) (offsetof(SL_NODE, next) + (h) * sizeof(_Atomic(uintptr_t)))
+#else
+#ifdef SKIPLIST_INDEXED
+/* Link widths live right after the forward pointers: width i is the number
+   of level 0 steps from the node to next[i], counting a NULL link as the
+   position one past the last node. */
+#define SL_LINKS_SIZE_(h) ((h) * (sizeof(SL_LINK_) + sizeof(unsigned long)))
+#define SL_WIDTH_(n, i) (((unsigned long *)((n)->next + (n)->height))[i])
+#else
+#define SL_LINKS_SIZE_(h) ((h) * sizeof(SL_LINK_))
+#endif
+#ifdef SKIPLIST_COLD_VALUES
+/* The value comes after the links (and widths), rounded up to its
+   alignment, so its offset depends on the node's height. */
+#define SL_VAL_ALIGN_ offsetof(SKIPLIST_NAME(_val_probe), v)
+#define SL_VAL_OFFSET_(h) ((offsetof(SL_NODE, next) + SL_LINKS_SIZE_(h) + SL_VAL_ALIGN_ - 1) / SL_VAL_ALIGN_ * SL_VAL_ALIGN_)
+#define SL_VALUE_(n) (*(SL_VAL *)((char *)(n) + SL_VAL_OFFSET_((n)->height)))
+#define SL_NODE_SIZE(h) (SL_VAL_OFFSET_(h) + sizeof(SL_VAL))
+#else
+#define SL_NODE_SIZE(h) (offsetof(SL_NODE, next) + SL_LINKS_SIZE_(h))
+#endif
+#endif
+/* Values are read and written through these, SL_VALUE_AT_ and friends
+   being for the arrays in fat nodes. Sets have no values to store: writes
+   are dropped and reads give 0. */
+#ifdef SL_SET_
+#define SL_VALUE_(n) ((SL_VAL)0)
+#define SL_SET_VALUE_(n, v) ((void)0)
+#define SL_VALUE_AT_(n, i) ((SL_VAL)0)
+#define SL_SET_VALUE_AT_(n, i, v) ((void)0)
+#define SL_MOVE_VALUES_(dst, src, count) ((void)0)
+#else
+#ifndef SL_VALUE_
+#define SL_VALUE_(n) ((n)->val)
+#endif
+#define SL_SET_VALUE_(n, v) (SL_VALUE_(n) = (v))
+#define SL_VALUE_AT_(n, i) ((n)->vals[i])
+#define SL_SET_VALUE_AT_(n, i, v) ((n)->vals[i] = (v))
+#define SL_MOVE_VALUES_(dst, src, count) memmove((dst), (src), (count) * sizeof(SL_VAL))
+#endif
+
+/* SL_STAT_ bumps one of the list's SKIPLIST_STATS counters, and compiles
+   to nothing without it. */
+#ifdef SKIPLIST_STATS
+#define SL_STAT_(list, c) ((void)++(list)->stats.c)
+#else
+#define SL_STAT_(list, c) ((void)0)
+#endif
+
+#if defined(SKIPLIST_INT_KEYS)
+#define SL_ORDER_(list, a, b) (((a) > (b)) - ((a) < (b)))
+#elif defined(SKIPLIST_CMP)
+#define SL_ORDER_(list, a, b) SKIPLIST_CMP(a, b, (list)->cmp_udata)
+#else
+#define SL_ORDER_(list, a, b) (list)->cmp(a, b, (list)->cmp_udata)
+#endif
+#ifdef SKIPLIST_STATS
+#define SL_COMPARE_(list, a, b) (SL_STAT_(list, compares), SL_ORDER_(list, a, b))
+#else
+#define SL_COMPARE_(list, a, b) SL_ORDER_(list, a, b)
+#endif
+
+/* 1 if SKIPLIST_MULTI allows equal keys. New keys are then placed past
+   the ones equal to them, and two keys are out of order only if the
+   first compares greater. */
+#ifdef SKIPLIST_MULTI
+#define SL_DUPS_ 1
+#else
+#define SL_DUPS_ 0
+#endif
+
+#ifdef SKIPLIST_KEY_BYTES
+#define SL_KEY_BYTES_(k, len) SKIPLIST_KEY_BYTES(k, len)
+#else
+#define SL_KEY_BYTES_(k, len) ((len) = sizeof(SL_KEY), (const void *)&(k))
+#endif
+#ifdef SKIPLIST_KEY_LOAD
+#define SL_KEY_LOAD_(k, buf, len, udata) SKIPLIST_KEY_LOAD(k, buf, len, udata)
+#else
+#define SL_KEY_LOAD_(k, buf, len, udata) ((len) != sizeof(SL_KEY) || (memcpy(&(k), (buf), sizeof(SL_KEY)), 0))
+#endif
+#if defined(SL_SET_)
+#define SL_VAL_BYTES_(v, len) ((len) = 0, (const void *)NULL)
+#elif defined(SKIPLIST_VALUE_BYTES)
+#define SL_VAL_BYTES_(v, len) SKIPLIST_VALUE_BYTES(v, len)
+#else
+#define SL_VAL_BYTES_(v, len) ((len) = sizeof(SL_VAL), (const void *)&(v))
+#endif
+#if defined(SL_SET_)
+#define SL_VAL_LOAD_(v, buf, len, udata) ((v) = 0, (len) != 0)
+#elif defined(SKIPLIST_VALUE_LOAD)
+#define SL_VAL_LOAD_(v, buf, len, udata) SKIPLIST_VALUE_LOAD(v, buf, len, udata)
+#else
+#define SL_VAL_LOAD_(v, buf, len, udata) ((len) != sizeof(SL_VAL) || (memcpy(&(v), (buf), sizeof(SL_VAL)), 0))
+#endif
+/* Serialized pairs travel in blocks of up to this many bytes, and a
+   varint takes at most SL_VARINT_MAX_ of them. */
+#define SL_STREAM_MAGIC_ "sls1"
+#define SL_BLOCK_ 4096
+#define SL_VARINT_MAX_ ((sizeof(size_t) * 8 + 6) / 7)
+
+#ifdef __GNUC__
+#define SL_PREFETCH_(p) __builtin_prefetch(p)
+#else
+#define SL_PREFETCH_(p) ((void)0)
+#endif
+
+/* Vector compares for searching fat nodes of integer keys, picked by the
+   instruction set the compiler targets. SL_SIMD_ is the vector width in
+   bytes; SSE2 has no 64-bit compare, so SL_SIMD64_ says whether 64-bit
+   keys can use it too. */
+#if defined(SKIPLIST_FAT_NODES) && defined(SKIPLIST_INT_KEYS) && !defined(SKIPLIST_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SL_SIMD_ 32
+#define SL_SIMD64_
+#define SL_VEC_ __m256i
+#define SL_VLOAD_(p) _mm256_loadu_si256((const __m256i *)(p))
+#define SL_VSTORE_(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+#define SL_VZERO_() _mm256_setzero_si256()
+#define SL_VXOR_(a, b) _mm256_xor_si256((a), (b))
+#define SL_VSET32_(x) _mm256_set1_epi32((x))
+#define SL_VGT32_(a, b) _mm256_cmpgt_epi32((a), (b))
+#define SL_VSUB32_(a, b) _mm256_sub_epi32((a), (b))
+#define SL_VSET64_(x) _mm256_set1_epi64x((x))
+#define SL_VGT64_(a, b) _mm256_cmpgt_epi64((a), (b))
+#define SL_VSUB64_(a, b) _mm256_sub_epi64((a), (b))
+#elif defined(__SSE2__) || defined(_M_X64)
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#define SL_SIMD64_
+#define SL_VSET64_(x) _mm_set1_epi64x((x))
+#define SL_VGT64_(a, b) _mm_cmpgt_epi64((a), (b))
+#define SL_VSUB64_(a, b) _mm_sub_epi64((a), (b))
+#else
+#include <emmintrin.h>
+#endif
+#define SL_SIMD_ 16
+#define SL_VEC_ __m128i
+#define SL_VLOAD_(p) _mm_loadu_si128((const __m128i *)(p))
+#define SL_VSTORE_(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define SL_VZERO_() _mm_setzero_si128()
+#define SL_VXOR_(a, b) _mm_xor_si128((a), (b))
+#define SL_VSET32_(x) _mm_set1_epi32((x))
+#define SL_VGT32_(a, b) _mm_cmpgt_epi32((a), (b))
+#define SL_VSUB32_(a, b) _mm_sub_epi32((a), (b))
+#endif
+#endif
+
+#ifdef SKIPLIST_POOL
+#ifndef SKIPLIST_POOL_SLAB
+#define SKIPLIST_POOL_SLAB 64
+#endif
+#define SL_POOL SKIPLIST_NAME(_pool)
+#endif
+#if defined(SKIPLIST_POOL) || defined(SKIPLIST_PERSIST)
+/* Slab and file nodes are packed back to back, so round each one up to
+   the strictest alignment of anything a node may contain. */
+#define SL_NODE_ALIGN_ offsetof(SKIPLIST_NAME(_align_probe), u)
+#define SL_ALIGN_UP_(sz) (((sz) + SL_NODE_ALIGN_ - 1) / SL_NODE_ALIGN_ * SL_NODE_ALIGN_)
+#endif
 
 #ifndef SKIPLIST_RAND
-#include <stdlib.h>
-#include <time.h>
-void SKIPLIST_NAME(_stdsrand)(void *_userdata);
+#define SL_BUILTIN_RAND_
 #ifdef SKIPLIST_IMPLEMENTATION
-void SKIPLIST_NAME(_stdsrand)(void *_userdata) {
-    time_t t;
-    srand((unsigned)time(&t));
-}
+#include <time.h>
 #endif
-#define SKIPLIST_RAND(udata) rand()
-#define SKIPLIST_SRAND(udata) SKIPLIST_NAME(_stdsrand)(udata)
+#elif !defined(SKIPLIST_SRAND)
+#define SKIPLIST_SRAND(udata)
 #endif
 
+#include <stdint.h>
+
 typedef int (* SL_CMP_FN)(SL_KEY, SL_KEY, void *);
 typedef int (* SL_ITER_FN)(SL_KEY, SL_VAL, void *);
+typedef size_t (* SL_WRITE_FN)(const void *, size_t, void *);
+typedef size_t (* SL_READ_FN)(void *, size_t, void *);
+
+#ifdef SL_EPOCHS_
+/* Threads announce the epoch they are reading in on one of these. Each
+   counter counts the readers that entered during epochs equal to its
+   index modulo 3. */
+typedef struct {
+    _Alignas(64) atomic_ulong active[3];
+    atomic_uint ops;
+} SKIPLIST_NAME(_stripe);
+#endif
+
+#ifndef SKIPLIST_CONCURRENT
 
+#ifdef SKIPLIST_STATS
+/* What a list counts with SKIPLIST_STATS, and what stats reports. The
+   counters run from init, open or the last stats_reset; the rest is
+   measured by stats itself. */
+typedef struct {
+    /* Calls to each operation */
+    unsigned long finds;
+    unsigned long inserts;
+    unsigned long removes;
+    unsigned long pops;
+    unsigned long shifts;
+    /* Descents from the head, key comparisons, and the nodes stepped onto
+       along each level while descending */
+    unsigned long searches;
+    unsigned long compares;
+    unsigned long visits[SKIPLIST_MAX_LEVELS];
+    /* Nodes allocated and freed, not counting the head */
+    unsigned long allocs;
+    unsigned long frees;
+    /* heights[i] is the number of nodes of height i + 1 */
+    unsigned long heights[SKIPLIST_MAX_LEVELS];
+    unsigned int highest;
+    unsigned long size;
+    /* Bytes taken by the head and the nodes in the list */
+    size_t bytes;
+    /* Nodes visited per descent, over every level */
+    double avg_path;
+} SL_STATS;
+#endif
+
+#ifdef SKIPLIST_FAT_NODES
+/* A node holds count pairs, sorted, all from its first key up to the next
+   node's first key. Only the head is ever empty. Keys are kept apart from
+   values so that searching a node reads as few cache lines as possible. */
+typedef struct SKIPLIST_NAME(_node) {
+    unsigned int height;
+    unsigned int count;
+    SL_KEY keys[SKIPLIST_FAT_NODES];
+#ifndef SL_SET_
+    SL_VAL vals[SKIPLIST_FAT_NODES];
+#endif
+    struct SKIPLIST_NAME(_node) *prev;
+    struct SKIPLIST_NAME(_node) *next[SL_FLEX_];
+} SL_NODE;
+#else
 typedef struct SKIPLIST_NAME(_node) {
     unsigned int height;
     SL_KEY key;
+#if !defined(SKIPLIST_COLD_VALUES) && !defined(SL_SET_)
     SL_VAL val;
-    struct SKIPLIST_NAME(_node) *prev;
-    struct SKIPLIST_NAME(_node) *next[SKIPLIST_MAX_LEVELS];
+#endif
+#ifdef SKIPLIST_PERSIST
+    intptr_t prev;
+    intptr_t next[SL_FLEX_];
+#else
+#ifdef SKIPLIST_SWMR
+    /* The next node on the same limbo list, once this one is removed */
+    struct SKIPLIST_NAME(_node) *limbo;
+#endif
+    struct SKIPLIST_NAME(_node) *SL_ATOMIC_ prev;
+    struct SKIPLIST_NAME(_node) *SL_ATOMIC_ next[SL_FLEX_];
+#endif
 } SL_NODE;
+#endif
+
+#ifdef SKIPLIST_COLD_VALUES
+typedef struct {
+    char c;
+    SL_VAL v;
+} SKIPLIST_NAME(_val_probe);
+#endif
+
+#if defined(SKIPLIST_POOL) || defined(SKIPLIST_PERSIST)
+typedef struct {
+    char c;
+    union { SL_KEY k; SL_VAL v; void *p; unsigned long w; uint64_t q; } u;
+} SKIPLIST_NAME(_align_probe);
+#endif
+
+#ifdef SKIPLIST_PERSIST
+/* The start of a list's file. Offsets count from the start of the file,
+   and 0 stands for NULL. The list struct keeps its own copy of size,
+   highest, tail and the generator state, which sync writes back here;
+   `clean` is cleared, and flushed, before the first change after a sync,
+   so a file that was not synced since its last change is never mistaken
+   for a good one. */
+typedef struct {
+    char magic[8];
+    uint64_t layout[8];
+    uint64_t clean;
+    uint64_t used;
+    uint64_t size;
+    uint64_t highest;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t rng;
+    /* Freed nodes of each height, chained through next[0] */
+    uint64_t free[SKIPLIST_MAX_LEVELS];
+} SKIPLIST_NAME(_file);
+#endif
+
+#ifdef SKIPLIST_POOL
+
+/* Freed nodes are kept on a free list per height, chained through next[0].
+   Slabs are chained through their first word and only released when the
+   last list using the pool is freed. Moving nodes between lists joins
+   their pools: one pool hands all its slabs to the other and forwards
+   to it through `parent`. */
+typedef struct SKIPLIST_NAME(_pool_s) {
+    unsigned long refs;
+    struct SKIPLIST_NAME(_pool_s) *parent;
+    void *mem_udata;
+    void *slabs;
+    SL_NODE *free[SKIPLIST_MAX_LEVELS];
+} SL_POOL;
+#endif
 
 typedef struct {
     unsigned long size;
-    unsigned int highest;
+    unsigned int SL_ATOMIC_ highest;
     SL_CMP_FN cmp;
     void *cmp_udata;
     void *mem_udata;
     void *rand_udata;
     SKIPLIST_NAME(node) *head;
+    SKIPLIST_NAME(node) *SL_ATOMIC_ tail;
+#ifdef SKIPLIST_POOL
+    SL_POOL *pool;
+#endif
+#ifdef SL_BUILTIN_RAND_
+    uint64_t rng;
+#endif
+#ifdef SKIPLIST_PERSIST
+    /* The mapped file, or NULL if the list was made by init. `mapped` is
+       the address space reserved for it, which the file may grow into. */
+    SKIPLIST_NAME(_file) *file;
+    size_t mapped;
+    size_t file_size;
+    int fd;
+#endif
+#ifdef SKIPLIST_SWMR
+    /* Removed nodes wait on limbo[e % 3], chained through their own limbo
+       field, e being the epoch they were removed in. */
+    atomic_ulong epoch;
+    SL_NODE *limbo[3];
+    unsigned int retired;
+    SKIPLIST_NAME(_stripe) stripes[SKIPLIST_EPOCH_STRIPES];
+#endif
+#ifdef SKIPLIST_STATS
+    SL_STATS stats;
+#endif
 } SL_LIST;
 
+/* A position in a skiplist, for walking it in either direction without
+   callbacks. Cursors need no cleanup and may be copied freely. Removing
+   the key a cursor is on invalidates that cursor; any other changes to
+   the list leave it valid, except with SKIPLIST_FAT_NODES where every
+   insert and remove invalidates all cursors. */
+typedef struct {
+    SKIPLIST_NAME(node) *node;
+#ifdef SKIPLIST_FAT_NODES
+    unsigned int index;
+#endif
+} SL_CURSOR;
+
 /* Must be called prior to using any other functions on a skiplist.
  * @list a pointer to the skiplist to initialize
- * @cmp the comparator function to use to order nodes
+ * @cmp the comparator function to use to order nodes. Ignored (and may
+ *      be NULL) if SKIPLIST_CMP is defined.
  * @cmp_udata Opaque pointer to pass to cmp
  * @mem_udata Opaque pointer to pass to the SKIPLIST_MALLOC and
  *            SKIPLIST_FREE macros. Unused by default, but custom
   *           memory allocators may use it.
  * @rand_udata Opaque pointer to pass to the SKIPLIST_RAND and
- *             SKIPLIST_SRAND macros. Unused by default, but custom
- *             RNGs may use it.
+ *             SKIPLIST_SRAND macros. The built-in generator ignores it
+ *             and seeds itself from the time and the list's address;
+ *             call seed afterwards for a reproducible level sequence.
  *
  * @return 0 if successful and nonzero if something failed
  */
@@ -183,11 +729,74 @@ SKIPLIST_EXTERN
 int SKIPLIST_NAME(init)(SL_LIST *list, SL_CMP_FN cmp, void *cmp_udata, void *mem_udata, void *rand_udata);
 
 /* Free memory used by a skiplist.
- * @list Free this guy from his bondage to memory.
+ * @list Free this guy from his bondage to memory. A list made by open is
+ *       unmapped without syncing, so unless nothing changed since the
+ *       last sync, its file can no longer be opened.
  */
 SKIPLIST_EXTERN
 void SKIPLIST_NAME(free)(SL_LIST *list);
 
+#ifdef SKIPLIST_PERSIST
+/* Opens a skiplist kept in a file, or creates it there if the file is
+ * missing or empty. The nodes stay in the file, mapped into memory, so
+ * opening takes the same time whatever the list's size, and the list is
+ * used like any other. Keys and values are stored as they are and must
+ * not contain pointers. Only a program built with the same key and value
+ * types and options can open the file.
+ *
+ * Any number of processes may open a file read-only at once, all sharing
+ * the same pages, but a process with it open for writing has it to
+ * itself. A read-only list must not be changed.
+ *
+ * @list the skiplist to open, instead of calling init
+ * @path the file holding the list
+ * @readonly nonzero to open the file read-only
+ * @max_size the largest the file may grow to while open, in bytes. This
+ *           much address space is reserved up front. Once the file is
+ *           full, insertions fail.
+ * @cmp, @cmp_udata, @mem_udata, @rand_udata as for init. With the
+ *      built-in generator, an existing list carries on where it left off.
+ *
+ * @return 0 if successful, 1 if the file could not be opened, locked,
+ *         created or mapped, and 2 if it does not hold a list of this type
+ *         or was changed after its last sync.
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(open)(SL_LIST *list, const char *path, int readonly, size_t max_size,
+                        SL_CMP_FN cmp, void *cmp_udata, void *mem_udata, void *rand_udata);
+
+/* Writes a list opened by open back to its file and waits for the disk.
+ * Until the next change, the file can be opened again as it is now, even
+ * if this process dies. Does nothing for other lists.
+ * @list An initialized skiplist
+ *
+ * @return 0 if successful, nonzero if the file could not be written
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(sync)(SL_LIST *list);
+
+/* Syncs and frees a list opened by open.
+ * @list An initialized skiplist, which is freed even if syncing fails
+ *
+ * @return the result of sync
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(close)(SL_LIST *list);
+#endif
+
+#ifdef SL_BUILTIN_RAND_
+/* Reseeds the list's built-in random number generator, which init seeds
+ * from the time. Call it right after init for reproducible heights.
+ * @list An initialized skiplist
+ * @seed Any value; equal seeds give equal node heights for equal
+ *       sequences of operations.
+ *
+ * Only available when SKIPLIST_RAND is not defined.
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(seed)(SL_LIST *list, uint64_t seed);
+#endif
+
 /* Sets a value in the skiplist.
  * @list An initialized skiplist
  * @key Associate the value with this key
@@ -197,24 +806,211 @@ void SKIPLIST_NAME(free)(SL_LIST *list);
  *
  * If a value already exists at that key,
  * overwrite it and stick the prior value in this function's out parameter.
+ * With SKIPLIST_MULTI, nothing is overwritten: the pair is added after any
+ * with an equal key, so equal keys stay in the order they were inserted.
  *
  * @return 0 if no value was at this key, 1 if a value did exist and was
- *          overwritten.
+ *          overwritten, -1 if a new node could not be allocated.
  */
 SKIPLIST_EXTERN
 short SKIPLIST_NAME(insert)(SL_LIST *list, SL_KEY key, SL_VAL val, SL_VAL *prior);
 
+#ifndef SKIPLIST_FAT_NODES
+/* Appends a sorted array of key/value pairs in one linear pass.
+ * @list An initialized skiplist. It must be empty, or every key in `keys`
+ *       must be greater than its largest key.
+ * @keys Keys in strictly increasing order, or just increasing with
+ *       SKIPLIST_MULTI
+ * @vals Values, `vals[i]` being associated with `keys[i]`
+ * @n Number of pairs
+ *
+ * Node heights are assigned deterministically rather than randomly, so the
+ * result is perfectly balanced. With SKIPLIST_POOL, nodes of each height
+ * come from a single slab.
+ *
+ * @return 0 if successful, 1 if the keys were out of order (the list is
+ *         left unchanged), -1 if a node could not be allocated (the list
+ *         holds the pairs before that point).
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(build_sorted)(SL_LIST *list, const SL_KEY *keys, const SL_VAL *vals, unsigned long n);
+
+/* Inserts many key/value pairs, sharing work between nearby keys.
+ * @list An initialized skiplist
+ * @keys Keys to insert, ideally in increasing order
+ * @vals Values, `vals[i]` being associated with `keys[i]`
+ * @n Number of pairs
+ * @on_replace If non-NULL, called with each key that already existed and
+ *             the value about to be overwritten. Its result is ignored.
+ * @userdata An opaque pointer to pass to `on_replace`
+ *
+ * Behaves like calling `insert` for each pair in turn, but each search
+ * resumes from where the previous one ended as long as the keys are
+ * increasing. Any order is accepted; out of order keys just restart the
+ * search from the top.
+ *
+ * @return The number of keys that were not already in the list, or -1 if
+ *         a node could not be allocated (the pairs before that point are
+ *         inserted).
+ */
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(insert_sorted_batch)(SL_LIST *list, const SL_KEY *keys, const SL_VAL *vals, unsigned long n, SL_ITER_FN on_replace, void *userdata);
+
+#ifndef SKIPLIST_PERSIST
+/* Moves every node of one skiplist into another.
+ * @dst An initialized skiplist to merge into
+ * @src An initialized skiplist using the same comparator and allocator.
+ *      It is left empty but still initialized.
+ *
+ * Nodes are relinked, not copied, so nothing is allocated. Where both
+ * lists have a key, the value from `src` wins. With SKIPLIST_POOL, the two
+ * lists share one pool from then on.
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(merge)(SL_LIST *dst, SL_LIST *src);
+#endif
+
+/* Removes every pair whose key is in [lo, hi).
+ * @list An initialized skiplist
+ * @lo The smallest key to remove
+ * @hi The key to stop before
+ *
+ * A single descent finds both ends of the range, each level is relinked
+ * once, and the removed nodes are then freed in one pass, so this costs
+ * O(log n) plus the number of pairs removed.
+ *
+ * @return The number of pairs removed
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(erase_range)(SL_LIST *list, SL_KEY lo, SL_KEY hi);
+
+#ifndef SKIPLIST_PERSIST
+/* Moves every pair whose key is not less than `key` into another list.
+ * @list An initialized skiplist
+ * @key The smallest key to move
+ * @out An initialized, empty skiplist using the same comparator and
+ *      allocator. With SKIPLIST_POOL, it shares list's pool from then on.
+ *
+ * Nodes are relinked at the split point, not copied, so this costs
+ * O(log n) plus counting the pairs on the shorter side of the split, and
+ * just O(log n) with SKIPLIST_INDEXED. With SKIPLIST_SWMR, readers of list
+ * may still be in the moved nodes, so call synchronize on list before
+ * removing anything from out.
+ *
+ * @return The number of pairs moved
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(split)(SL_LIST *list, SL_KEY key, SL_LIST *out);
+#endif
+
+/* Finds the keys two lists have in common, in increasing order.
+ * @a An initialized skiplist
+ * @b An initialized skiplist using the same comparator. It may be `a`.
+ * @dst If non-NULL, an initialized skiplist other than `a` and `b` that
+ *      each pair is inserted into, overwriting any existing value
+ * @iter If non-NULL, called with each pair. If it returns non-zero, the
+ *       walk stops there.
+ * @userdata An opaque pointer to pass to `iter`
+ *
+ * Both lists are walked together, and whenever one falls behind it climbs
+ * its own links from where it stands to catch up, so a run of keys missing
+ * from the other list costs O(log d) for a run of length d. Intersecting m
+ * keys with n costs about O(m log(n/m)). The pairs come from `a`. With
+ * SKIPLIST_MULTI, each pair in `a` is matched with at most one in `b`.
+ *
+ * @return The number of pairs found, or -1 if a node could not be
+ *         allocated in dst (the pairs before that point are inserted)
+ */
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(intersect)(SL_LIST *a, SL_LIST *b, SL_LIST *dst, SL_ITER_FN iter, void *userdata);
+
+/* Like intersect, but finds every key in either list. Where both have a
+ * key, the pair from `a` is used. With SKIPLIST_MULTI, each pair in `a`
+ * stands in for at most one equal pair in `b`.
+ */
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(union)(SL_LIST *a, SL_LIST *b, SL_LIST *dst, SL_ITER_FN iter, void *userdata);
+
+/* Like intersect, but finds the pairs of `a` whose key is not in `b`. Runs
+ * of `b` with no key in `a` are skipped in O(log d). With SKIPLIST_MULTI,
+ * each pair in `b` cancels at most one equal pair in `a`.
+ */
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(difference)(SL_LIST *a, SL_LIST *b, SL_LIST *dst, SL_ITER_FN iter, void *userdata);
+
+/* Writes every key/value pair to a stream, in order: a four byte magic
+ * number and the number of pairs, then the pairs in blocks of a few
+ * kilobytes. Each block starts with its length, and each key and value
+ * is its length followed by that many bytes. All lengths and the count
+ * are LEB128 varints. How keys and values become bytes is up to
+ * SKIPLIST_KEY_BYTES and SKIPLIST_VALUE_BYTES.
+ * @list An initialized skiplist
+ * @write Called with consecutive pieces of the stream. It should consume
+ *        all of each one and return its length, like fwrite.
+ * @udata An opaque pointer to pass to `write`
+ *
+ * @return 0 if successful, 1 if `write` came up short
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(serialize)(SL_LIST *list, SL_WRITE_FN write, void *udata);
+
+/* Reads pairs written by serialize and appends them in one linear pass,
+ * like build_sorted. Reading stops right after the last pair, so several
+ * lists can share a stream.
+ * @list An initialized skiplist. It must be empty, or every key in the
+ *       stream must be greater than its largest key.
+ * @read Called to fill in the next `len` bytes of the stream. It returns
+ *       how many it stored, like fread, and 0 only if there are none left.
+ * @udata An opaque pointer to pass to `read`, SKIPLIST_KEY_LOAD and
+ *        SKIPLIST_VALUE_LOAD
+ *
+ * Keys are not searched for, so node heights are assigned as by
+ * build_sorted. If a pair is rejected, whatever SKIPLIST_KEY_LOAD or
+ * SKIPLIST_VALUE_LOAD made for it is not released.
+ *
+ * @return 0 if successful, 1 if the stream ended early or was not written
+ *         by serialize with the same hooks, or if its keys were out of
+ *         order, and -1 if a node could not be allocated. Either way, the
+ *         list holds the pairs before the failure.
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(deserialize)(SL_LIST *list, SL_READ_FN read, void *udata);
+#endif
+
 /* Gets a value associated with a key.
  * @list An initialized skiplist
  * @key Get the value associated with this key
  * @out If a value exists, store it at this location.
  *      If this parameter is NULL, nothing is stored.
+ *      With SKIPLIST_MULTI, this is the first value inserted at the key.
  *
  * @return 0 if the key does not exist, 1 if it does
  */
 SKIPLIST_EXTERN
 short SKIPLIST_NAME(find)(SL_LIST *list, SL_KEY key, SL_VAL *out);
 
+#ifndef SKIPLIST_FAT_NODES
+/* Gets the values associated with many keys at once.
+ * @list An initialized skiplist
+ * @keys Keys to look up
+ * @n Number of keys
+ * @out If non-NULL, the value for `keys[i]` is stored at `out[i]` if it
+ *      exists. Entries for missing keys are not touched.
+ * @found If non-NULL, `found[i]` is set to 1 if `keys[i]` exists and 0 if
+ *        it does not.
+ * @sort If non-zero, visit the keys in sorted order. This needs a
+ *       temporary array of n indices from SKIPLIST_MALLOC.
+ *
+ * Each search resumes from where the previous one ended instead of from
+ * the top of the list whenever the keys are increasing, so sorted or
+ * clustered batches cost much less than n separate calls to `find`.
+ *
+ * @return The number of keys found
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(find_many)(SL_LIST *list, const SL_KEY *keys, unsigned long n, SL_VAL *out, short *found, short sort);
+#endif
+
 /* Gets a value associated with a key, or a default value.
  * @list An initialized skiplist
  * @key Get the value associated with this key
@@ -232,326 +1028,3566 @@ SL_VAL SKIPLIST_NAME(get)(SL_LIST *list, SL_KEY key, SL_VAL default_val);
  * @key Key indicating the key/value pair to remove
  * @out If non-NULL and the key existed, store the old value at this location
  *
+ * With SKIPLIST_MULTI, only the first pair inserted at the key is removed.
+ *
  * @return 1 if the key used to be in the list (and was thus removed),
  *          0 if it was never there
  */
 SKIPLIST_EXTERN
 short SKIPLIST_NAME(remove)(SL_LIST *list, SL_KEY key, SL_VAL *out);
 
-/* Iterates through all key/value pairs in order.
+#ifdef SKIPLIST_MULTI
+/* Removes every pair with a given key.
  * @list An initialized skiplist
+ * @key Key of the pairs to remove
+ *
+ * Works like erase_range, in one descent and one pass over the pairs.
+ *
+ * @return The number of pairs removed
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(remove_all)(SL_LIST *list, SL_KEY key);
+
+/* Counts the pairs with a given key.
+ * @list An initialized skiplist
+ * @key Key to count
+ *
+ * @return The number of pairs with that key
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(count)(SL_LIST *list, SL_KEY key);
+
+/* Iterates through the pairs with a given key, in the order they were
+ * inserted.
+ * @list An initialized skiplist
+ * @key Key to visit
  * @iter An iterator function to call for each key/value pair
  * @userdata An opaque pointer to pass to `iter`.
  *
- * If `iter` returns a non-zero value, stop the iteration and return
- * that value.
+ * As with `iter`, a non-zero result from `iter` stops the iteration.
  *
  * @return The first non-zero result of `iter` or 0 if `iter` always
  *         returned 0.
  */
 SKIPLIST_EXTERN
-int SKIPLIST_NAME(iter)(SL_LIST *list, SL_ITER_FN iter, void *userdata);
+int SKIPLIST_NAME(find_all)(SL_LIST *list, SL_KEY key, SL_ITER_FN iter, void *userdata);
 
-/* Does what it says on the tin.
+/* Positions a cursor on the first pair with a given key and counts the
+ * pairs with it. Moving the cursor forward count - 1 times visits the
+ * rest, in the order they were inserted.
  * @list An initialized skiplist
+ * @cur The cursor to position, if non-NULL. Left past the end of the
+ *      list, or on the next larger key, if there is no such pair.
+ * @key Key to look for
  *
- * @return The number of key/value pairs in the skiplist
+ * @return The number of pairs with that key
  */
 SKIPLIST_EXTERN
-unsigned long SKIPLIST_NAME(size)(SL_LIST *list);
+unsigned long SKIPLIST_NAME(equal_range)(SL_LIST *list, SL_CURSOR *cur, SL_KEY key);
+#endif
 
-/* Returns the minimum key and value in this list.
- * @list An initalized skiplist
- * @key_out Set to the smallest key if non-NULL and the list is not empty
- * @val_out Set to the value associated with the smallest key if non-NULL
- *          and the list is not empty.
+/* Iterates through all key/value pairs in order.
+ * @list An initialized skiplist
+ * @iter An iterator function to call for each key/value pair
+ * @userdata An opaque pointer to pass to `iter`.
  *
- * @return 0 if the list is empty and 1 if it is not
+ * If `iter` returns a non-zero value, stop the iteration and return
+ * that value.
+ *
+ * @return The first non-zero result of `iter` or 0 if `iter` always
+ *         returned 0.
  */
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(min)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+int SKIPLIST_NAME(iter)(SL_LIST *list, SL_ITER_FN iter, void *userdata);
 
-/* Returns the maximum key and value in this list.
- * @list An initalized skiplist
- * @key_out Set to the largest key if non-NULL and the list is not empty
- * @val_out Set to the value associated with the largest key if non-NULL
- *          and the list is not empty.
+/* Iterates in order through the key/value pairs with lo <= key < hi.
+ * @list An initialized skiplist
+ * @lo Smallest key to visit
+ * @hi Stop before this key
+ * @iter An iterator function to call for each key/value pair
+ * @userdata An opaque pointer to pass to `iter`.
  *
- * @return 0 if the list is empty and 1 if it is not
+ * Only the keys in range are visited, after a single descent to `lo`.
+ * As with `iter`, a non-zero result from `iter` stops the iteration.
+ *
+ * @return The first non-zero result of `iter` or 0 if `iter` always
+ *         returned 0.
  */
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(max)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+int SKIPLIST_NAME(iter_range)(SL_LIST *list, SL_KEY lo, SL_KEY hi, SL_ITER_FN iter, void *userdata);
 
-/* Removes and returns the minimum key/value pair from a list.
+/* Finds the smallest key that is not less than a given key.
  * @list An initialized skiplist
- * @key_out Set to the smallest key if non-NULL and the list is not empty
- * @val_out Set to the value associated with the smallest key if non-NULL
- *          and the list is not empty.
+ * @key Key to search for
+ * @key_out Set to the key found if non-NULL and there is one
+ * @val_out Set to the value associated with the key found if non-NULL
+ *          and there is one
  *
- * @return 0 if the list was already empty and 1 if it was not
+ * @return 0 if every key in the list is less than `key`, 1 otherwise
  */
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(pop)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+short SKIPLIST_NAME(lower_bound)(SL_LIST *list, SL_KEY key, SL_KEY *key_out, SL_VAL *val_out);
 
-/* Removes and returns the maximum key/value pair from a list.
+/* Finds the smallest key that is greater than a given key.
  * @list An initialized skiplist
- * @key_out Set to the largest key if non-NULL and the list is not empty
- * @val_out Set to the value associated with the largest key if non-NULL
- *          and the list is not empty.
+ * @key Key to search for
+ * @key_out Set to the key found if non-NULL and there is one
+ * @val_out Set to the value associated with the key found if non-NULL
+ *          and there is one
  *
- * @return 0 if the list was already empty and 1 if it was not
+ * @return 0 if no key in the list is greater than `key`, 1 otherwise
  */
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(shift)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+short SKIPLIST_NAME(upper_bound)(SL_LIST *list, SL_KEY key, SL_KEY *key_out, SL_VAL *val_out);
 
-#ifdef SKIPLIST_IMPLEMENTATION
-
-SKIPLIST_EXTERN
-int SKIPLIST_NAME(init)(SL_LIST *list, SL_CMP_FN cmp, void *cmp_udata, void *mem_udata, void *rand_udata) {
+/* Does what it says on the tin.
+ * @list An initialized skiplist
+ *
+ * @return The number of key/value pairs in the skiplist
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(size)(SL_LIST *list);
+
+#ifdef SKIPLIST_STATS
+/* Reports what the list has counted, along with its shape: how many nodes
+ * there are of each height, and how much memory they take. Walks the
+ * whole list.
+ * @list An initialized skiplist
+ * @out Filled in with the counters and the list's shape
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(stats)(SL_LIST *list, SL_STATS *out);
+
+/* Zeroes the list's counters.
+ * @list An initialized skiplist
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(stats_reset)(SL_LIST *list);
+#endif
+
+#ifdef SKIPLIST_INDEXED
+/* Counts the keys less than a given key.
+ * @list An initialized skiplist
+ * @key Key to search for
+ * @out If non-NULL, set to the number of keys less than `key`, which is
+ *      its index if it is in the list.
+ *
+ * Only available if SKIPLIST_INDEXED is defined.
+ *
+ * @return 1 if the key is in the list, 0 if not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(rank)(SL_LIST *list, SL_KEY key, unsigned long *out);
+
+/* Gets the key/value pair at a given position in order.
+ * @list An initialized skiplist
+ * @index 0 for the smallest key, size - 1 for the largest
+ * @key_out Set to the key at `index` if non-NULL and `index` is in range
+ * @val_out Set to the value at `index` if non-NULL and `index` is in range
+ *
+ * Only available if SKIPLIST_INDEXED is defined.
+ *
+ * @return 0 if `index` is not less than the size of the list, 1 otherwise
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(at)(SL_LIST *list, unsigned long index, SL_KEY *key_out, SL_VAL *val_out);
+
+/* Removes the key/value pair at a given position in order.
+ * @list An initialized skiplist
+ * @index 0 for the smallest key, size - 1 for the largest
+ * @key_out Set to the removed key if non-NULL and `index` is in range
+ * @val_out Set to the removed value if non-NULL and `index` is in range
+ *
+ * Only available if SKIPLIST_INDEXED is defined.
+ *
+ * @return 0 if `index` is not less than the size of the list, 1 otherwise
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(remove_at)(SL_LIST *list, unsigned long index, SL_KEY *key_out, SL_VAL *val_out);
+#endif
+
+/* Positions a cursor on the smallest key in a list.
+ * @list An initialized skiplist
+ * @cur The cursor to position
+ *
+ * @return 0 if the list is empty and 1 if it is not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_first)(SL_LIST *list, SL_CURSOR *cur);
+
+/* Positions a cursor on the largest key in a list.
+ * @list An initialized skiplist
+ * @cur The cursor to position
+ *
+ * @return 0 if the list is empty and 1 if it is not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_last)(SL_LIST *list, SL_CURSOR *cur);
+
+/* Positions a cursor on the smallest key not less than a given key.
+ * @list An initialized skiplist
+ * @cur The cursor to position
+ * @key Key to search for
+ *
+ * @return 0 if every key in the list is less than `key`, 1 otherwise
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_seek)(SL_LIST *list, SL_CURSOR *cur, SL_KEY key);
+
+/* Moves a cursor to the next larger key.
+ * @cur A positioned cursor
+ *
+ * @return 0 if the cursor was on the largest key (and is now past the
+ *         end), 1 otherwise
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_next)(SL_CURSOR *cur);
+
+/* Moves a cursor to the next smaller key.
+ * @cur A positioned cursor
+ *
+ * @return 0 if the cursor was on the smallest key (and is now past the
+ *         beginning), 1 otherwise
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_prev)(SL_CURSOR *cur);
+
+/* Reads the key/value pair a cursor is on.
+ * @cur A cursor
+ * @key_out Set to the current key if non-NULL and the cursor is positioned
+ * @val_out Set to the current value if non-NULL and the cursor is positioned
+ *
+ * @return 0 if the cursor has moved past either end of the list or its
+ *         list was empty, 1 otherwise
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_get)(SL_CURSOR *cur, SL_KEY *key_out, SL_VAL *val_out);
+
+/* Returns the minimum key and value in this list.
+ * @list An initalized skiplist
+ * @key_out Set to the smallest key if non-NULL and the list is not empty
+ * @val_out Set to the value associated with the smallest key if non-NULL
+ *          and the list is not empty.
+ *
+ * @return 0 if the list is empty and 1 if it is not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(min)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+
+/* Returns the maximum key and value in this list.
+ * @list An initalized skiplist
+ * @key_out Set to the largest key if non-NULL and the list is not empty
+ * @val_out Set to the value associated with the largest key if non-NULL
+ *          and the list is not empty.
+ *
+ * @return 0 if the list is empty and 1 if it is not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(max)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+
+/* Removes and returns the minimum key/value pair from a list.
+ * @list An initialized skiplist
+ * @key_out Set to the smallest key if non-NULL and the list is not empty
+ * @val_out Set to the value associated with the smallest key if non-NULL
+ *          and the list is not empty.
+ *
+ * @return 0 if the list was already empty and 1 if it was not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(pop)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+
+/* Removes and returns the maximum key/value pair from a list.
+ * @list An initialized skiplist
+ * @key_out Set to the largest key if non-NULL and the list is not empty
+ * @val_out Set to the value associated with the largest key if non-NULL
+ *          and the list is not empty.
+ *
+ * @return 0 if the list was already empty and 1 if it was not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(shift)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+
+#ifdef SKIPLIST_SWMR
+/* Starts a read-side critical section.
+ * @list An initialized skiplist
+ *
+ * Nodes removed while any reader is inside a critical section are not
+ * freed until it ends, so cursors stay valid across calls until the
+ * matching read_unlock. find, get, find_many, iter, iter_range,
+ * lower_bound, upper_bound, min and max take one internally. Sections may
+ * nest, but must not span a call to synchronize from the same thread.
+ *
+ * Only available if SKIPLIST_SWMR is defined.
+ *
+ * @return A token to pass to read_unlock
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(read_lock)(SL_LIST *list);
+
+/* Ends a read-side critical section.
+ * @list An initialized skiplist
+ * @token The value returned by the matching read_lock
+ *
+ * Only available if SKIPLIST_SWMR is defined.
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(read_unlock)(SL_LIST *list, unsigned long token);
+
+/* Waits for every reader that might still see a removed node, then frees
+ * all removed nodes.
+ * @list An initialized skiplist
+ *
+ * The writer reclaims memory in the background as it goes; this is only
+ * needed to bound memory use at a known point. Writer only.
+ *
+ * Only available if SKIPLIST_SWMR is defined.
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(synchronize)(SL_LIST *list);
+#endif
+
+#ifdef SKIPLIST_SHARDED
+/* Picks the shard a key lives in. Must return a value below `count` and
+   always the same one for the same key. */
+typedef unsigned int (* SL_SPLIT_FN)(SL_KEY, unsigned int, void *);
+
+typedef struct {
+    SKIPLIST_LOCK_TYPE lock;
+    SL_LIST list;
+    /* Keeps the next shard's lock off the cache lines this shard's
+       writers touch. */
+    char pad[64];
+} SKIPLIST_NAME(_shard);
+
+typedef struct {
+    unsigned int count;
+    SL_SPLIT_FN split;
+    void *split_udata;
+    void *mem_udata;
+    SKIPLIST_NAME(_shard) *shards;
+    /* Scratch space for merging the shards in iter, which holds every
+       lock while it runs: one cursor per shard and a heap of shards
+       ordered by their cursors' keys. */
+    SL_CURSOR *cursors;
+    unsigned int *heap;
+} SL_SHARDED;
+
+/* Must be called prior to using any other sharded_* functions.
+ * @s a pointer to the sharded list to initialize
+ * @count number of shards, at least 1
+ * @split the function that routes each key to its shard
+ * @split_udata Opaque pointer to pass to split
+ * @cmp the comparator shared by all shards, as in init
+ * @cmp_udata Opaque pointer to pass to cmp
+ * @mem_udata NULL, or an array of `count` pointers to pass to the
+ *            SKIPLIST_MALLOC and SKIPLIST_FREE macros, one per shard. The
+ *            first one is also used for the shard array itself.
+ * @rand_udata NULL, or an array of `count` pointers to pass as each
+ *             shard's rand_udata, as in init.
+ *
+ * Only available if SKIPLIST_SHARDED is defined.
+ *
+ * @return 0 if successful and nonzero if something failed
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(sharded_init)(SL_SHARDED *s, unsigned int count, SL_SPLIT_FN split, void *split_udata, SL_CMP_FN cmp, void *cmp_udata, void **mem_udata, void **rand_udata);
+
+/* Free memory used by a sharded list.
+ * @s No other thread may be using it any more.
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(sharded_free)(SL_SHARDED *s);
+
+/* Adds a key/value pair, locking only the key's shard.
+ * Arguments and return value as for insert.
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(sharded_insert)(SL_SHARDED *s, SL_KEY key, SL_VAL val, SL_VAL *prior);
+
+/* Gets a value associated with a key, locking only the key's shard.
+ * Arguments and return value as for find.
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(sharded_find)(SL_SHARDED *s, SL_KEY key, SL_VAL *out);
+
+/* Gets a value associated with a key, or a default value.
+ * Arguments and return value as for get.
+ */
+SKIPLIST_EXTERN
+SL_VAL SKIPLIST_NAME(sharded_get)(SL_SHARDED *s, SL_KEY key, SL_VAL default_val);
+
+/* Removes a key/value pair, locking only the key's shard.
+ * Arguments and return value as for remove.
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(sharded_remove)(SL_SHARDED *s, SL_KEY key, SL_VAL *out);
+
+/* Counts the key/value pairs in all shards.
+ * @s An initialized sharded list
+ *
+ * Shards are counted one at a time, so while other threads are writing
+ * this is only an estimate.
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(sharded_size)(SL_SHARDED *s);
+
+/* Iterates through all key/value pairs in key order, whatever the
+ * splitter, by merging the shards.
+ * @s An initialized sharded list
+ * @iter An iterator function to call for each key/value pair
+ * @userdata An opaque pointer to pass to `iter`.
+ *
+ * Every shard stays locked until the iteration ends, so `iter` must not
+ * call back into the sharded list.
+ *
+ * @return The first non-zero result of `iter` or 0 if `iter` always
+ *         returned 0.
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(sharded_iter)(SL_SHARDED *s, SL_ITER_FN iter, void *userdata);
+#endif
+
+#else /* SKIPLIST_CONCURRENT */
+
+/* Links are tagged pointers: the low bit of next[i] marks the node as
+   deleted at level i, after which that link never changes again. A node
+   is in the list from the moment it is linked at level 0 until its
+   next[0] is marked; the upper levels only speed up searches. */
+typedef struct SKIPLIST_NAME(_node) {
+    unsigned int height;
+    /* Dropped once by the inserter when it has stopped linking the node
+       and once by the remover when it has unlinked it. Whoever drops the
+       last reference retires the node. */
+    atomic_uint refs;
+    SL_KEY key;
+#ifndef SL_SET_
+    SL_VAL val;
+#endif
+    struct SKIPLIST_NAME(_node) *retired;
+    _Atomic(uintptr_t) next[];
+} SL_NODE;
+
+typedef struct {
+    atomic_ulong size;
+    atomic_uint highest;
+    SL_CMP_FN cmp;
+    void *cmp_udata;
+    void *mem_udata;
+    void *rand_udata;
+    SKIPLIST_NAME(node) *head;
+#ifdef SL_BUILTIN_RAND_
+    uint64_t rng;
+#endif
+    /* Removed nodes wait on limbo[e % 3], e being the epoch they were
+       retired in, until every thread that might have seen them is gone. */
+    atomic_ulong epoch;
+    _Atomic(SL_NODE *) limbo[3];
+    SKIPLIST_NAME(_stripe) stripes[SKIPLIST_EPOCH_STRIPES];
+} SL_LIST;
+
+/* Must be called prior to using any other functions on a skiplist, and
+ * before the list is shared with other threads.
+ * @list a pointer to the skiplist to initialize
+ * @cmp the comparator function to use to order nodes. Ignored (and may
+ *      be NULL) if SKIPLIST_CMP is defined.
+ * @cmp_udata Opaque pointer to pass to cmp
+ * @mem_udata Opaque pointer to pass to the SKIPLIST_MALLOC and
+ *            SKIPLIST_FREE macros.
+ * @rand_udata Opaque pointer to pass to the SKIPLIST_RAND and
+ *             SKIPLIST_SRAND macros. The built-in generator ignores it:
+ *             each thread seeds its own from the list's, which comes
+ *             from the time and the list's address, so heights are never
+ *             reproducible across runs.
+ *
+ * @return 0 if successful and nonzero if something failed
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(init)(SL_LIST *list, SL_CMP_FN cmp, void *cmp_udata, void *mem_udata, void *rand_udata);
+
+/* Free memory used by a skiplist, including nodes still waiting to be
+ * reclaimed.
+ * @list No other thread may be using the list any more.
+ */
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(free)(SL_LIST *list);
+
+/* Adds a key/value pair to the skiplist unless the key is already there.
+ * @list An initialized skiplist
+ * @key Associate the value with this key
+ * @val Value
+ * @prior If non-NULL and the key already exists, its current value is
+ *        stored at this location.
+ *
+ * Unlike the single-threaded insert, an existing value is never
+ * overwritten: values are read without locks, so they cannot change once
+ * published. Remove and insert again to replace one.
+ *
+ * @return 0 if the pair was added, 1 if the key already existed, -1 if a
+ *         new node could not be allocated.
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(insert)(SL_LIST *list, SL_KEY key, SL_VAL val, SL_VAL *prior);
+
+/* Gets a value associated with a key. Never waits on other threads.
+ * @list An initialized skiplist
+ * @key Get the value associated with this key
+ * @out If a value exists, store it at this location.
+ *      If this parameter is NULL, nothing is stored.
+ *
+ * @return 0 if the key does not exist, 1 if it does
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(find)(SL_LIST *list, SL_KEY key, SL_VAL *out);
+
+/* Gets a value associated with a key, or a default value.
+ * @list An initialized skiplist
+ * @key Get the value associated with this key
+ * @default_val If the key does not exist in this list,
+ *              return this value instead.
+ *
+ * @return The value associated with the key or default_val if the
+ *          key is not set.
+ */
+SKIPLIST_EXTERN
+SL_VAL SKIPLIST_NAME(get)(SL_LIST *list, SL_KEY key, SL_VAL default_val);
+
+/* Removes a key/value pair from this list.
+ * @list An initialized skiplist
+ * @key Key indicating the key/value pair to remove
+ * @out If non-NULL and the key existed, store the old value at this location
+ *
+ * When several threads remove the same key, exactly one of them gets 1.
+ *
+ * @return 1 if the key used to be in the list (and was thus removed),
+ *          0 if it was never there
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(remove)(SL_LIST *list, SL_KEY key, SL_VAL *out);
+
+/* Iterates through all key/value pairs in order.
+ * @list An initialized skiplist
+ * @iter An iterator function to call for each key/value pair
+ * @userdata An opaque pointer to pass to `iter`.
+ *
+ * Keys inserted or removed by other threads during the iteration may or
+ * may not be visited. No removed node is reclaimed until the iteration
+ * ends, so keep `iter` short.
+ *
+ * @return The first non-zero result of `iter` or 0 if `iter` always
+ *         returned 0.
+ */
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(iter)(SL_LIST *list, SL_ITER_FN iter, void *userdata);
+
+/* Counts the key/value pairs in the skiplist.
+ * @list An initialized skiplist
+ *
+ * @return The number of key/value pairs in the skiplist. While other
+ *         threads are changing the list this is only an estimate.
+ */
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(size)(SL_LIST *list);
+
+/* Returns the minimum key and value in this list.
+ * @list An initalized skiplist
+ * @key_out Set to the smallest key if non-NULL and the list is not empty
+ * @val_out Set to the value associated with the smallest key if non-NULL
+ *          and the list is not empty.
+ *
+ * @return 0 if the list is empty and 1 if it is not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(min)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+
+/* Removes and returns the minimum key/value pair from a list.
+ * @list An initialized skiplist
+ * @key_out Set to the smallest key if non-NULL and the list is not empty
+ * @val_out Set to the value associated with the smallest key if non-NULL
+ *          and the list is not empty.
+ *
+ * Safe to call from many threads at once; each pair is handed to exactly
+ * one of them.
+ *
+ * @return 0 if the list was already empty and 1 if it was not
+ */
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(pop)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out);
+
+#endif /* SKIPLIST_CONCURRENT */
+
+#ifdef SKIPLIST_IMPLEMENTATION
+
+#ifdef SKIPLIST_POOL
+static void SKIPLIST_NAME(_pool_release)(SL_POOL *pool) {
+    SL_POOL *parent;
+    void *slab;
+    while (pool && --pool->refs == 0) {
+        parent = pool->parent;
+        while ((slab = pool->slabs)) {
+            pool->slabs = *(void **)slab;
+            SKIPLIST_FREE(pool->mem_udata, slab);
+        }
+        SKIPLIST_FREE(pool->mem_udata, pool);
+        pool = parent;
+    }
+}
+
+/* Returns the pool that owns the list's nodes, following any joins. */
+static SL_POOL *SKIPLIST_NAME(_pool_of)(SL_LIST *list) {
+    SL_POOL *root = list->pool;
+    if (root->parent) {
+        while (root->parent)
+            root = root->parent;
+        ++root->refs;
+        SKIPLIST_NAME(_pool_release)(list->pool);
+        list->pool = root;
+    }
+    return root;
+}
+
+#ifndef SKIPLIST_FAT_NODES
+/* Makes dst's pool own everything src's pool owns, so nodes can move from
+   src to dst. Both lists must use the same allocator. */
+static void SKIPLIST_NAME(_pool_join)(SL_LIST *dst, SL_LIST *src) {
+    SL_POOL *from = SKIPLIST_NAME(_pool_of)(src), *to = SKIPLIST_NAME(_pool_of)(dst);
+    SL_NODE *n;
+    void **slab;
+    unsigned int h;
+
+    if (from == to)
+        return;
+    if (from->slabs) {
+        for (slab = &from->slabs; *slab; slab = (void **)*slab)
+            ;
+        *slab = to->slabs;
+        to->slabs = from->slabs;
+        from->slabs = NULL;
+    }
+    for (h = 0; h < SKIPLIST_MAX_LEVELS; ++h) {
+        if (from->free[h]) {
+            for (n = from->free[h]; SL_NEXT_(n, 0); n = SL_NEXT_(n, 0))
+                ;
+            SL_SET_NEXT_(n, 0, to->free[h]);
+            to->free[h] = from->free[h];
+            from->free[h] = NULL;
+        }
+    }
+    from->parent = to;
+    ++to->refs;
+    SKIPLIST_NAME(_pool_of)(src);
+}
+#endif
+
+/* Adds a slab of `count` nodes of the given height to the pool's free list. */
+static int SKIPLIST_NAME(_pool_reserve)(SL_LIST *list, unsigned int height, unsigned long count) {
+    SL_POOL *pool = SKIPLIST_NAME(_pool_of)(list);
+    size_t hdr = SL_ALIGN_UP_(sizeof(void *)),
+           stride = SL_ALIGN_UP_(SL_NODE_SIZE(height));
+    char *slab, *p;
+    SL_NODE *n;
+
+    slab = (char *)SKIPLIST_MALLOC(pool->mem_udata, hdr + count * stride);
+    if (!slab)
+        return 1;
+    *(void **)slab = pool->slabs;
+    pool->slabs = slab;
+
+    p = slab + hdr + count * stride;
+    while (p > slab + hdr) {
+        p -= stride;
+        n = (SL_NODE *)p;
+        SL_SET_NEXT_(n, 0, pool->free[height - 1]);
+        pool->free[height - 1] = n;
+    }
+    return 0;
+}
+#endif
+
+#ifdef SKIPLIST_PERSIST
+static SL_NODE *SKIPLIST_NAME(_follow)(const intptr_t *link) {
+    return *link ? (SL_NODE *)((uintptr_t)link + (uintptr_t)*link) : NULL;
+}
+
+static void SKIPLIST_NAME(_point)(intptr_t *link, SL_NODE *n) {
+    *link = n ? (intptr_t)((uintptr_t)n - (uintptr_t)link) : 0;
+}
+
+#define SL_FILE_NODE_(f, off) ((off) ? (SL_NODE *)((char *)(f) + (off)) : NULL)
+#define SL_FILE_OFF_(f, n) ((n) ? (uint64_t)((char *)(n) - (char *)(f)) : 0)
+
+/* Every change to a list begins in _alloc_node, _unlink or _assign, which
+   call this first. The file is marked as changed, on disk, before any of
+   its pages are. */
+static void SKIPLIST_NAME(_touch)(SL_LIST *list) {
+    if (list->file && list->file->clean) {
+        list->file->clean = 0;
+        msync(list->file, sizeof *list->file, MS_SYNC);
+    }
+}
+#define SL_TOUCH_(list) SKIPLIST_NAME(_touch)(list)
+
+/* Takes a node from the file's free list for its height, or from the end
+   of the file, which grows by doubling up to the space reserved for it. */
+static SL_NODE *SKIPLIST_NAME(_file_alloc)(SL_LIST *list, unsigned int height) {
+    SKIPLIST_NAME(_file) *f = list->file;
+    size_t size = SL_ALIGN_UP_(SL_NODE_SIZE(height)), grow;
+    SL_NODE *n;
+
+    SKIPLIST_NAME(_touch)(list);
+    if (f->free[height - 1]) {
+        n = SL_FILE_NODE_(f, f->free[height - 1]);
+        f->free[height - 1] = SL_FILE_OFF_(f, SL_NEXT_(n, 0));
+        return n;
+    }
+    if (size > list->mapped - f->used)
+        return NULL;
+    if (f->used + size > list->file_size) {
+        grow = list->file_size < list->mapped / 2 ? list->file_size * 2 : list->mapped;
+        if (grow < f->used + size)
+            grow = f->used + size;
+        if (ftruncate(list->fd, (off_t)grow))
+            return NULL;
+        list->file_size = grow;
+    }
+    n = SL_FILE_NODE_(f, f->used);
+    f->used += size;
+    return n;
+}
+#else
+#define SL_TOUCH_(list)
+#endif
+
+static SL_NODE *SKIPLIST_NAME(_alloc_node)(SL_LIST *list, unsigned int height) {
+    SL_NODE *n;
+#ifdef SKIPLIST_POOL
+    SL_POOL *pool = SKIPLIST_NAME(_pool_of)(list);
+    unsigned long count = height <= 16 ? (unsigned long)SKIPLIST_POOL_SLAB >> (height - 1) : 0;
+#endif
+    (void)list;
+#ifdef SKIPLIST_PERSIST
+    if (list->file) {
+        if (!(n = SKIPLIST_NAME(_file_alloc)(list, height)))
+            return NULL;
+        n->height = height;
+        SL_STAT_(list, allocs);
+        return n;
+    }
+#endif
+#ifdef SKIPLIST_POOL
+    if (!pool->free[height - 1] &&
+        SKIPLIST_NAME(_pool_reserve)(list, height, count ? count : 1))
+        return NULL;
+    n = pool->free[height - 1];
+    pool->free[height - 1] = SL_NEXT_(n, 0);
+#else
+    n = (SL_NODE *)SKIPLIST_MALLOC(list->mem_udata, SL_NODE_SIZE(height));
+    if (!n)
+        return NULL;
+#endif
+    n->height = height;
+    SL_STAT_(list, allocs);
+    return n;
+}
+
+static void SKIPLIST_NAME(_free_node)(SL_LIST *list, SL_NODE *n) {
+#ifdef SKIPLIST_POOL
+    SL_POOL *pool = SKIPLIST_NAME(_pool_of)(list);
+#endif
+    (void)list;
+    SL_STAT_(list, frees);
+#ifdef SKIPLIST_POOL
+    SL_SET_NEXT_(n, 0, pool->free[n->height - 1]);
+    pool->free[n->height - 1] = n;
+#else
+#ifdef SKIPLIST_PERSIST
+    if (list->file) {
+        SL_SET_NEXT_(n, 0, SL_FILE_NODE_(list->file, list->file->free[n->height - 1]));
+        list->file->free[n->height - 1] = SL_FILE_OFF_(list->file, n);
+        return;
+    }
+#endif
+    SKIPLIST_FREE(list->mem_udata, n);
+#endif
+}
+
+#ifdef SL_BUILTIN_RAND_
+/* splitmix64: one add and two multiplies per draw, and any seed is fine. */
+#ifdef SKIPLIST_CONCURRENT
+/* Threads draw from their own generators, seeded from the list's seed and
+   the address of their copy of the state. */
+static _Thread_local uint64_t SKIPLIST_NAME(_rng);
+static uint64_t SKIPLIST_NAME(_rand64)(SL_LIST *list) {
+    uint64_t z;
+    if (!SKIPLIST_NAME(_rng))
+        SKIPLIST_NAME(_rng) = list->rng ^ (uint64_t)(uintptr_t)&SKIPLIST_NAME(_rng);
+    z = (SKIPLIST_NAME(_rng) += UINT64_C(0x9E3779B97F4A7C15));
+#else
+static uint64_t SKIPLIST_NAME(_rand64)(SL_LIST *list) {
+    uint64_t z = (list->rng += UINT64_C(0x9E3779B97F4A7C15));
+#endif
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+#define SL_RAND64_(list) SKIPLIST_NAME(_rand64)(list)
+#else
+#define SL_RAND64_(list) ((uint64_t)SKIPLIST_RAND((list)->rand_udata))
+#endif
+
+static unsigned int SKIPLIST_NAME(_ctz64)(uint64_t x) {
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctzll(x);
+#else
+    unsigned int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/* Draws a height with P(h) = 2^-h from the trailing zeros of one draw.
+   The sentinel bit caps it at SKIPLIST_MAX_LEVELS (or 64). */
+static unsigned int SKIPLIST_NAME(_random_height)(SL_LIST *list) {
+    uint64_t r = SL_RAND64_(list);
+    (void)list;
+#if SKIPLIST_MAX_LEVELS < 64
+    r |= (uint64_t)1 << (SKIPLIST_MAX_LEVELS - 1);
+#else
+    r |= (uint64_t)1 << 63;
+#endif
+    return SKIPLIST_NAME(_ctz64)(r) + 1;
+}
+
+#ifdef SL_EPOCHS_
+static SKIPLIST_NAME(_stripe) *SKIPLIST_NAME(_stripe_of)(SL_LIST *list) {
+    static atomic_uint threads;
+    static _Thread_local unsigned int slot;
+    if (!slot)
+        slot = atomic_fetch_add(&threads, 1) + 1;
+    return &list->stripes[(slot - 1) % SKIPLIST_EPOCH_STRIPES];
+}
+
+static unsigned long SKIPLIST_NAME(_enter)(SL_LIST *list, SKIPLIST_NAME(_stripe) *s) {
+    unsigned long e;
+    for (;;) {
+        e = atomic_load(&list->epoch);
+        atomic_fetch_add(&s->active[e % 3], 1);
+        /* If the epoch moved on in between, the advancing thread may not
+           have seen this announcement. */
+        if (atomic_load(&list->epoch) == e)
+            return e;
+        atomic_fetch_sub(&s->active[e % 3], 1);
+    }
+}
+
+#endif
+
+#ifndef SKIPLIST_CONCURRENT
+
+#ifdef SKIPLIST_SWMR
+/* Readers never write to the list. The writer retires removed nodes into
+   limbo[e % 3], e being the current epoch, and every so often tries to
+   advance the epoch from e to e + 1, which is allowed once no reader is
+   left in e - 1. Nothing retired in e - 1 can be reached by the readers
+   that remain, so that limbo list is freed. */
+static void SKIPLIST_NAME(_free_chain)(SL_LIST *list, SL_NODE *n) {
+    SL_NODE *later;
+    while (n) {
+        later = n->limbo;
+        SKIPLIST_NAME(_free_node)(list, n);
+        n = later;
+    }
+}
+
+static int SKIPLIST_NAME(_reclaim)(SL_LIST *list) {
+    unsigned long e = atomic_load_explicit(&list->epoch, memory_order_relaxed);
+    SL_NODE *n;
+    unsigned int i;
+    for (i = 0; i < SKIPLIST_EPOCH_STRIPES; ++i) {
+        if (atomic_load(&list->stripes[i].active[(e + 2) % 3]))
+            return 0;
+    }
+    atomic_store(&list->epoch, e + 1);
+    n = list->limbo[(e + 2) % 3];
+    list->limbo[(e + 2) % 3] = NULL;
+    SKIPLIST_NAME(_free_chain)(list, n);
+    return 1;
+}
+#endif
+
+/* Frees a node that has been unlinked. In SWMR mode readers may still be
+   on it, and may still follow its links either way, so it waits for them
+   instead. */
+static void SKIPLIST_NAME(_retire_node)(SL_LIST *list, SL_NODE *n) {
+#ifdef SKIPLIST_SWMR
+    unsigned long e = atomic_load_explicit(&list->epoch, memory_order_relaxed);
+    n->limbo = list->limbo[e % 3];
+    list->limbo[e % 3] = n;
+    if ((++list->retired & 63) == 0)
+        SKIPLIST_NAME(_reclaim)(list);
+#else
+    SKIPLIST_NAME(_free_node)(list, n);
+#endif
+}
+
+#ifdef SKIPLIST_SWMR
+#define SL_READ_BEGIN_(list) unsigned long sl_token_ = SKIPLIST_NAME(read_lock)(list)
+#define SL_READ_END_(list) SKIPLIST_NAME(read_unlock)((list), sl_token_)
+#else
+#define SL_READ_BEGIN_(list)
+#define SL_READ_END_(list)
+#endif
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(init)(SL_LIST *list, SL_CMP_FN cmp, void *cmp_udata, void *mem_udata, void *rand_udata) {
     list->cmp = cmp;
     list->cmp_udata = cmp_udata;
     list->mem_udata = mem_udata;
     list->rand_udata = rand_udata;
+#ifdef SL_BUILTIN_RAND_
+    SKIPLIST_NAME(seed)(list, (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)list);
+#else
     SKIPLIST_SRAND(rand_udata);
+#endif
     list->highest = 0;
     list->size = 0;
-    list->head = (SL_NODE *)SKIPLIST_MALLOC(mem_udata, sizeof(SL_NODE));
+#ifdef SKIPLIST_PERSIST
+    list->file = NULL;
+#endif
+    list->head = (SL_NODE *)SKIPLIST_MALLOC(mem_udata, SL_NODE_SIZE(SKIPLIST_MAX_LEVELS));
+    if (!list->head)
+        return 1;
+#ifdef SKIPLIST_POOL
+    list->pool = (SL_POOL *)SKIPLIST_MALLOC(mem_udata, sizeof(SL_POOL));
+    if (!list->pool) {
+        SKIPLIST_FREE(mem_udata, list->head);
+        return 1;
+    }
+    list->pool->refs = 1;
+    list->pool->parent = NULL;
+    list->pool->mem_udata = mem_udata;
+    list->pool->slabs = NULL;
+    memset(list->pool->free, 0, sizeof list->pool->free);
+#endif
     list->head->height = SKIPLIST_MAX_LEVELS;
-    memset(list->head->next, 0, SKIPLIST_MAX_LEVELS * sizeof(SL_NODE *));
+#ifdef SKIPLIST_FAT_NODES
+    list->head->count = 0;
+#endif
+    SL_SET_PREV_(list->head, NULL);
+    SL_SET_TAIL_(list, NULL);
+    memset(list->head->next, 0, SKIPLIST_MAX_LEVELS * sizeof(SL_LINK_));
+#ifdef SKIPLIST_SWMR
+    atomic_init(&list->epoch, 0);
+    memset(list->limbo, 0, sizeof list->limbo);
+    list->retired = 0;
+    memset(list->stripes, 0, sizeof list->stripes);
+#endif
+#ifdef SKIPLIST_STATS
+    SKIPLIST_NAME(stats_reset)(list);
+#endif
+    return 0;
+}
+
+#ifdef SL_BUILTIN_RAND_
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(seed)(SL_LIST *list, uint64_t seed) {
+    list->rng = seed;
+    /* Scramble once so that nearby seeds give unrelated sequences. */
+    list->rng = SKIPLIST_NAME(_rand64)(list);
+}
+#endif
+
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(free)(SL_LIST *list) {
+    SL_NODE *n, *next;
+#ifdef SKIPLIST_SWMR
+    unsigned int i;
+#endif
+#ifdef SKIPLIST_PERSIST
+    if (list->file) {
+        munmap(list->file, list->mapped);
+        close(list->fd);
+        return;
+    }
+#endif
+#ifdef SKIPLIST_POOL
+    /* Nodes only need to go back on the free lists if another list still
+       shares the pool. */
+    if (SKIPLIST_NAME(_pool_of)(list)->refs > 1) {
+#endif
+    n = SL_NEXT_(list->head, 0);
+    while (n) {
+        next = SL_NEXT_(n, 0);
+        SKIPLIST_NAME(_free_node)(list, n);
+        n = next;
+    }
+#ifdef SKIPLIST_SWMR
+    for (i = 0; i < 3; ++i)
+        SKIPLIST_NAME(_free_chain)(list, list->limbo[i]);
+#endif
+#ifdef SKIPLIST_POOL
+    }
+    SKIPLIST_NAME(_pool_release)(list->pool);
+#endif
+    SKIPLIST_FREE(list->mem_udata, list->head);
+}
+
+#ifdef SKIPLIST_PERSIST
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(open)(SL_LIST *list, const char *path, int readonly, size_t max_size,
+                        SL_CMP_FN cmp, void *cmp_udata, void *mem_udata, void *rand_udata) {
+    static const char magic[8] = {'s', 'k', 'i', 'p', 'l', 'i', 's', '1'};
+    SKIPLIST_NAME(_file) *f;
+    uint64_t layout[8];
+    struct flock lock;
+    struct stat st;
+    size_t first = SL_ALIGN_UP_(sizeof *f), size;
+    int fd, fresh, err = 1;
+
+    /* Anything that changes where a node keeps its parts, or how the
+       keys in the file are ordered */
+    layout[0] = sizeof(SL_KEY);
+    layout[1] = sizeof(SL_VAL);
+    layout[2] = SL_NODE_SIZE(2);
+    layout[3] = SKIPLIST_MAX_LEVELS;
+    layout[4] = offsetof(SL_NODE, key);
+    layout[5] = offsetof(SL_NODE, next);
+#if defined(SL_SET_)
+    layout[6] = 0;
+#elif defined(SKIPLIST_COLD_VALUES)
+    layout[6] = SL_VAL_OFFSET_(1);
+#else
+    layout[6] = offsetof(SL_NODE, val);
+#endif
+    layout[7] = 0;
+#ifdef SKIPLIST_COLD_VALUES
+    layout[7] |= 1;
+#endif
+#ifdef SKIPLIST_INDEXED
+    layout[7] |= 2;
+#endif
+#ifdef SKIPLIST_MULTI
+    layout[7] |= 4;
+#endif
+#ifdef SKIPLIST_INT_KEYS
+    layout[7] |= 8;
+#endif
+#ifdef SKIPLIST_CMP
+    layout[7] |= 16;
+#endif
+
+    fd = open(path, readonly ? O_RDONLY : O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        return 1;
+    memset(&lock, 0, sizeof lock);
+    lock.l_type = readonly ? F_RDLCK : F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    if (fcntl(fd, F_SETLK, &lock) || fstat(fd, &st))
+        goto fail;
+    size = (size_t)st.st_size;
+    fresh = size == 0;
+    if (fresh && !readonly) {
+        size = first + SL_ALIGN_UP_(SL_NODE_SIZE(SKIPLIST_MAX_LEVELS));
+        if (ftruncate(fd, (off_t)size))
+            goto fail;
+    }
+    else if (size < first) {
+        err = 2;
+        goto fail;
+    }
+    if (readonly || max_size < size)
+        max_size = size;
+    f = (SKIPLIST_NAME(_file) *)mmap(NULL, max_size, readonly ? PROT_READ : PROT_READ | PROT_WRITE,
+                                     MAP_SHARED, fd, 0);
+    if (f == MAP_FAILED)
+        goto fail;
+    if (fresh) {
+        /* The rest of the header and the head node are zero, and a zero
+           link is NULL. */
+        memcpy(f->magic, magic, sizeof magic);
+        memcpy(f->layout, layout, sizeof layout);
+        f->used = size;
+        f->head = first;
+        SL_FILE_NODE_(f, first)->height = SKIPLIST_MAX_LEVELS;
+    }
+    else if (memcmp(f->magic, magic, sizeof magic) || memcmp(f->layout, layout, sizeof layout) ||
+             !f->clean || f->used > size) {
+        munmap(f, max_size);
+        err = 2;
+        goto fail;
+    }
+
+    list->cmp = cmp;
+    list->cmp_udata = cmp_udata;
+    list->mem_udata = mem_udata;
+    list->rand_udata = rand_udata;
+    list->file = f;
+    list->mapped = max_size;
+    list->file_size = size;
+    list->fd = fd;
+    list->head = SL_FILE_NODE_(f, f->head);
+    list->tail = SL_FILE_NODE_(f, f->tail);
+    list->size = (unsigned long)f->size;
+    list->highest = (unsigned int)f->highest;
+#ifdef SL_BUILTIN_RAND_
+    if (!fresh)
+        list->rng = f->rng;
+    else
+        SKIPLIST_NAME(seed)(list, (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)list);
+#else
+    SKIPLIST_SRAND(rand_udata);
+#endif
+#ifdef SKIPLIST_STATS
+    SKIPLIST_NAME(stats_reset)(list);
+#endif
+    if (fresh && SKIPLIST_NAME(sync)(list)) {
+        SKIPLIST_NAME(free)(list);
+        return 1;
+    }
+    return 0;
+
+fail:
+    close(fd);
+    return err;
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(sync)(SL_LIST *list) {
+    SKIPLIST_NAME(_file) *f = list->file;
+    if (!f || f->clean)
+        return 0;
+    f->size = list->size;
+    f->highest = list->highest;
+    f->tail = SL_FILE_OFF_(f, list->tail);
+#ifdef SL_BUILTIN_RAND_
+    f->rng = list->rng;
+#endif
+    if (msync(f, f->used, MS_SYNC))
+        return 1;
+    f->clean = 1;
+    return msync(f, sizeof *f, MS_SYNC) != 0;
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(close)(SL_LIST *list) {
+    int err = SKIPLIST_NAME(sync)(list);
+    SKIPLIST_NAME(free)(list);
+    return err;
+}
+#endif
+
+/* Links in a new node. update[i] must be its predecessor on each level
+   below list->highest and, if indexed, rank[i] must be update[i]'s
+   position (the head is 0, the first node 1). */
+static void SKIPLIST_NAME(_link)(SL_LIST *list, SL_NODE *nn, SL_NODE **update, unsigned long *rank) {
+    unsigned int i;
+
+    while (nn->height > list->highest) {
+#ifdef SKIPLIST_INDEXED
+        rank[list->highest] = 0;
+        SL_WIDTH_(list->head, list->highest) = list->size + 1;
+#endif
+        update[list->highest++] = list->head;
+    }
+
+    /* Set all of nn's links before publishing it on any level, so that a
+       reader in SWMR mode never follows one that is not set yet. */
+    SL_SET_PREV_(nn, update[0] == list->head ? NULL : update[0]);
+    for (i = 0; i < nn->height; ++i)
+        SL_SET_NEXT_(nn, i, SL_NEXT_(update[i], i));
+    for (i = 0; i < nn->height; ++i)
+        SL_SET_NEXT_(update[i], i, nn);
+
+#ifdef SKIPLIST_INDEXED
+    for (i = 0; i < list->highest; ++i) {
+        if (i < nn->height) {
+            SL_WIDTH_(nn, i) = SL_WIDTH_(update[i], i) - (rank[0] - rank[i]);
+            SL_WIDTH_(update[i], i) = rank[0] - rank[i] + 1;
+        }
+        else
+            ++SL_WIDTH_(update[i], i);
+    }
+#else
+    (void)rank;
+#endif
+
+    if (SL_NEXT_(nn, 0))
+        SL_SET_PREV_(SL_NEXT_(nn, 0), nn);
+    else
+        SL_SET_TAIL_(list, nn);
+    ++list->size;
+}
+
+/* Unlinks a node without freeing it. update[i] must be its predecessor on
+   each level below list->highest. */
+static void SKIPLIST_NAME(_unlink)(SL_LIST *list, SL_NODE *n, SL_NODE **update) {
+    unsigned int i;
+
+    SL_TOUCH_(list);
+
+#ifdef SKIPLIST_INDEXED
+    for (i = 0; i < list->highest; ++i) {
+        if (i < n->height) {
+            SL_WIDTH_(update[i], i) += SL_WIDTH_(n, i) - 1;
+            SL_SET_NEXT_(update[i], i, SL_NEXT_(n, i));
+        }
+        else
+            --SL_WIDTH_(update[i], i);
+    }
+#else
+    for (i = 0; i < n->height; ++i)
+        SL_SET_NEXT_(update[i], i, SL_NEXT_(n, i));
+#endif
+
+    if (SL_NEXT_(n, 0))
+        SL_SET_PREV_(SL_NEXT_(n, 0), SL_PREV_(n));
+    else
+        SL_SET_TAIL_(list, SL_PREV_(n));
+    while (list->highest > 0 && SL_NEXT_(list->head, list->highest - 1) == NULL)
+        --list->highest;
+    --list->size;
+}
+
+#ifndef SKIPLIST_FAT_NODES
+
+/* Gives node n, which follows update[i] on each level, a new value. If nn
+   is non-NULL it is an unlinked node with n's key, which is freed.
+
+   Readers in SWMR mode may be reading n, so rather than writing to it, a
+   copy with the new value takes its place on each level in turn. A reader
+   sees either n or the copy, never both.
+   @return 0 if successful, -1 if a node could not be allocated */
+static int SKIPLIST_NAME(_assign)(SL_LIST *list, SL_NODE *n, SL_NODE *nn, SL_VAL val, SL_NODE **update, unsigned long *rank) {
+#if defined(SKIPLIST_SWMR) && !defined(SL_SET_)
+    SL_NODE *copy = SKIPLIST_NAME(_alloc_node)(list, n->height);
+    unsigned int i;
+    if (!copy) {
+        if (!nn)
+            return -1;
+        /* Readers may miss the key for a moment, but nothing is lost. */
+        SL_SET_VALUE_(nn, val);
+        SKIPLIST_NAME(_unlink)(list, n, update);
+        SKIPLIST_NAME(_link)(list, nn, update, rank);
+        SKIPLIST_NAME(_retire_node)(list, n);
+        return 0;
+    }
+    copy->key = n->key;
+    SL_SET_VALUE_(copy, val);
+    SL_SET_PREV_(copy, SL_PREV_(n));
+    for (i = 0; i < n->height; ++i) {
+        SL_SET_NEXT_(copy, i, SL_NEXT_(n, i));
+#ifdef SKIPLIST_INDEXED
+        SL_WIDTH_(copy, i) = SL_WIDTH_(n, i);
+#endif
+    }
+    for (i = 0; i < n->height; ++i)
+        SL_SET_NEXT_(update[i], i, copy);
+    if (SL_NEXT_(copy, 0))
+        SL_SET_PREV_(SL_NEXT_(copy, 0), copy);
+    else
+        SL_SET_TAIL_(list, copy);
+    SKIPLIST_NAME(_retire_node)(list, n);
+#else
+    (void)update;
+    (void)rank;
+#ifdef SL_SET_
+    (void)n;
+    (void)val;
+#endif
+    SL_TOUCH_(list);
+    SL_SET_VALUE_(n, val);
+#endif
+    if (nn)
+        SKIPLIST_NAME(_free_node)(list, nn);
+    return 0;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(insert)(SL_LIST *list, SL_KEY key, SL_VAL val, SL_VAL *prior) {
+    SL_NODE *n, *next, *nn, *update[SKIPLIST_MAX_LEVELS];
+    unsigned long *rank = NULL;
+    unsigned int i;
+    short replaced;
+#ifdef SKIPLIST_INDEXED
+    unsigned long ranks[SKIPLIST_MAX_LEVELS], r = 0;
+    rank = ranks;
+#endif
+
+    SL_STAT_(list, inserts);
+    SL_STAT_(list, searches);
+    n = list->head;
+
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && SL_COMPARE_(list, next->key, key) < SL_DUPS_) {
+#ifdef SKIPLIST_INDEXED
+            r += SL_WIDTH_(n, i);
+#endif
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        update[i] = n;
+#ifdef SKIPLIST_INDEXED
+        rank[i] = r;
+#endif
+    }
+
+    replaced = !SL_DUPS_ && SL_NEXT_(n, 0) != NULL && SL_COMPARE_(list, key, SL_NEXT_(n, 0)->key) == 0;
+    if (replaced) {
+        if (prior)
+            *prior = SL_VALUE_(SL_NEXT_(n, 0));
+        if (SKIPLIST_NAME(_assign)(list, SL_NEXT_(n, 0), NULL, val, update, rank))
+            return -1;
+    }
+    else {
+        /* Only allocate once we know the key is new, so updates never do. */
+        nn = SKIPLIST_NAME(_alloc_node)(list, SKIPLIST_NAME(_random_height)(list));
+        if (!nn)
+            return -1;
+        nn->key = key;
+        SL_SET_VALUE_(nn, val);
+        SKIPLIST_NAME(_link)(list, nn, update, rank);
+    }
+
+    return replaced;
+}
+
+/* Appends nodes in order without searching. last[i] is the last node on
+   level i and, if indexed, pos[i] is its position. */
+typedef struct {
+    SL_NODE *last[SKIPLIST_MAX_LEVELS];
+#ifdef SKIPLIST_INDEXED
+    unsigned long pos[SKIPLIST_MAX_LEVELS];
+#endif
+} SKIPLIST_NAME(_builder);
+
+static void SKIPLIST_NAME(_build_begin)(SL_LIST *list, SKIPLIST_NAME(_builder) *b) {
+    SL_NODE *n;
+    unsigned int i;
+#ifdef SKIPLIST_INDEXED
+    unsigned long r = 0;
+#endif
+    n = list->head;
+    for (i = SKIPLIST_MAX_LEVELS; i --> list->highest; ) {
+        b->last[i] = n;
+#ifdef SKIPLIST_INDEXED
+        b->pos[i] = 0;
+#endif
+    }
+    i = list->highest;
+    while (i --> 0) {
+        while (SL_NEXT_(n, i)) {
+#ifdef SKIPLIST_INDEXED
+            r += SL_WIDTH_(n, i);
+#endif
+            n = SL_NEXT_(n, i);
+        }
+        b->last[i] = n;
+#ifdef SKIPLIST_INDEXED
+        b->pos[i] = r;
+#endif
+    }
+}
+
+/* The node at position p gets height 1 + ctz(p), so level i holds every
+   2^i-th node. */
+static int SKIPLIST_NAME(_build_push)(SL_LIST *list, SKIPLIST_NAME(_builder) *b, SL_KEY key, SL_VAL val) {
+    SL_NODE *nn;
+    unsigned long pos = list->size + 1;
+    unsigned int i, height;
+#ifdef SL_SET_
+    (void)val;
+#endif
+
+    height = SKIPLIST_NAME(_ctz64)((uint64_t)pos) + 1;
+    if (height > SKIPLIST_MAX_LEVELS)
+        height = SKIPLIST_MAX_LEVELS;
+    nn = SKIPLIST_NAME(_alloc_node)(list, height);
+    if (!nn)
+        return -1;
+    nn->key = key;
+    SL_SET_VALUE_(nn, val);
+    SL_SET_PREV_(nn, b->last[0] == list->head ? NULL : b->last[0]);
+    for (i = 0; i < height; ++i) {
+        SL_SET_NEXT_(nn, i, NULL);
+        SL_SET_NEXT_(b->last[i], i, nn);
+#ifdef SKIPLIST_INDEXED
+        SL_WIDTH_(b->last[i], i) = pos - b->pos[i];
+        b->pos[i] = pos;
+#endif
+        b->last[i] = nn;
+    }
+    if (height > list->highest)
+        list->highest = height;
+    list->size = pos;
+    return 0;
+}
+
+static void SKIPLIST_NAME(_build_end)(SL_LIST *list, SKIPLIST_NAME(_builder) *b) {
+    unsigned int i;
+    for (i = 0; i < list->highest; ++i) {
+        SL_SET_NEXT_(b->last[i], i, NULL);
+#ifdef SKIPLIST_INDEXED
+        SL_WIDTH_(b->last[i], i) = list->size + 1 - b->pos[i];
+#endif
+    }
+    SL_SET_TAIL_(list, list->size ? b->last[0] : NULL);
+}
+
+#ifdef SKIPLIST_POOL
+/* Reserves one slab per height for appending n nodes with _build_push. */
+static int SKIPLIST_NAME(_build_reserve)(SL_LIST *list, unsigned long n) {
+    unsigned long lo = list->size, hi = list->size + n, count;
+    unsigned int h;
+    for (h = 1; h < SKIPLIST_MAX_LEVELS && h < 8 * sizeof(unsigned long); ++h) {
+        /* Positions in (lo, hi] divisible by 2^(h-1) but not by 2^h */
+        count = ((hi >> (h - 1)) - (lo >> (h - 1))) - ((hi >> h) - (lo >> h));
+        if (count && SKIPLIST_NAME(_pool_reserve)(list, h, count))
+            return -1;
+    }
+    count = (hi >> (h - 1)) - (lo >> (h - 1));
+    if (count && SKIPLIST_NAME(_pool_reserve)(list, h, count))
+        return -1;
+    return 0;
+}
+#endif
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(build_sorted)(SL_LIST *list, const SL_KEY *keys, const SL_VAL *vals, unsigned long n) {
+    SKIPLIST_NAME(_builder) b;
+    unsigned long i;
+    int err = 0;
+
+    if (n == 0)
+        return 0;
+    if (SL_TAIL_(list) && SL_COMPARE_(list, SL_TAIL_(list)->key, keys[0]) >= SL_DUPS_)
+        return 1;
+    for (i = 1; i < n; ++i) {
+        if (SL_COMPARE_(list, keys[i - 1], keys[i]) >= SL_DUPS_)
+            return 1;
+    }
+
+#ifdef SKIPLIST_POOL
+    if (SKIPLIST_NAME(_build_reserve)(list, n))
+        return -1;
+#endif
+    SKIPLIST_NAME(_build_begin)(list, &b);
+    for (i = 0; i < n && !err; ++i)
+        err = SKIPLIST_NAME(_build_push)(list, &b, keys[i], vals[i]);
+    SKIPLIST_NAME(_build_end)(list, &b);
+    return err;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(find)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
+    SL_NODE *n, *next;
+    int cmp;
+    unsigned int i;
+    short hit = 0;
+    SL_READ_BEGIN_(list);
+    SL_STAT_(list, finds);
+    SL_STAT_(list, searches);
+    n = list->head;
+    i = list->highest;
+
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i))) {
+            SL_STAT_(list, visits[i]);
+            if ((cmp = SL_COMPARE_(list, key, next->key)) == 0 && !SL_DUPS_)
+                goto found;
+            else if (cmp <= 0)
+                break;
+            n = next;
+        }
+    }
+    /* An equal key met on the way down need not be the first one. */
+    if (SL_DUPS_ && (next = SL_NEXT_(n, 0)) && SL_COMPARE_(list, key, next->key) == 0)
+        goto found;
+    goto done;
+
+    found:
+    if (out)
+        *out = SL_VALUE_(next);
+    hit = 1;
+    done:
+    SL_READ_END_(list);
+    return hit;
+}
+
+/* The search path of the previous key: update[i] is the last node on level
+   i with a key less than it, for the `height` levels the list had when the
+   path was built. A later key that is not smaller can resume from this
+   path instead of from the head. */
+typedef struct {
+    SL_NODE *update[SKIPLIST_MAX_LEVELS];
+#ifdef SKIPLIST_INDEXED
+    unsigned long rank[SKIPLIST_MAX_LEVELS];
+#endif
+    SL_KEY key;
+    unsigned int height;
+    short started;
+} SKIPLIST_NAME(_finger);
+
+/* Fills f->update with the last node on every level below list->highest
+   whose key is less than `key`, or not greater than it if `past` is 1, and
+   returns update[0]. */
+static SL_NODE *SKIPLIST_NAME(_finger_seek)(SL_LIST *list, SKIPLIST_NAME(_finger) *f, SL_KEY key, int past) {
+    SL_NODE *n, *next;
+    unsigned int i, top, highest = list->highest;
+#ifdef SKIPLIST_INDEXED
+    unsigned long r;
+#endif
+
+    if (highest == 0)
+        return list->head;
+    /* A path built on fewer levels has nothing above them to climb to: the
+       list grew in between, from _link or, under SKIPLIST_SWMR, from the
+       writer while a reader holds the finger. */
+    if (f->started && f->height == highest && SL_COMPARE_(list, key, f->key) >= 0) {
+        /* Climb until the old path no longer falls short of key; every
+           level above that is still a valid path. */
+        top = 0;
+        while (top + 1 < highest && (next = SL_NEXT_(f->update[top], top)) &&
+               SL_COMPARE_(list, next->key, key) < past)
+            ++top;
+        n = f->update[top];
+#ifdef SKIPLIST_INDEXED
+        r = f->rank[top];
+#endif
+    }
+    else {
+        top = highest - 1;
+        n = list->head;
+#ifdef SKIPLIST_INDEXED
+        r = 0;
+#endif
+        f->height = highest;
+    }
+
+    SL_STAT_(list, searches);
+    i = top + 1;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && SL_COMPARE_(list, next->key, key) < past) {
+#ifdef SKIPLIST_INDEXED
+            r += SL_WIDTH_(n, i);
+#endif
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        f->update[i] = n;
+#ifdef SKIPLIST_INDEXED
+        f->rank[i] = r;
+#endif
+    }
+    f->key = key;
+    f->started = 1;
+    return n;
+}
+
+/* Heapsorts idx[0..n) by keys[idx[i]]. */
+static void SKIPLIST_NAME(_sort_indices)(SL_LIST *list, const SL_KEY *keys, unsigned long *idx, unsigned long n) {
+    unsigned long start, end, root, child, t;
+    (void)list;
+    for (start = n / 2, end = n; end > 1; ) {
+        if (start > 0)
+            --start;
+        else {
+            --end;
+            t = idx[end]; idx[end] = idx[0]; idx[0] = t;
+        }
+        for (root = start; (child = 2 * root + 1) < end; root = child) {
+            if (child + 1 < end && SL_COMPARE_(list, keys[idx[child]], keys[idx[child + 1]]) < 0)
+                ++child;
+            if (SL_COMPARE_(list, keys[idx[root]], keys[idx[child]]) >= 0)
+                break;
+            t = idx[root]; idx[root] = idx[child]; idx[child] = t;
+        }
+    }
+}
+
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(find_many)(SL_LIST *list, const SL_KEY *keys, unsigned long n, SL_VAL *out, short *found, short sort) {
+    SKIPLIST_NAME(_finger) f;
+    SL_NODE *p, *m;
+    unsigned long i, j, *idx = NULL, hits = 0;
+    short hit;
+    SL_READ_BEGIN_(list);
+
+    if (sort && n > 1) {
+        idx = (unsigned long *)SKIPLIST_MALLOC(list->mem_udata, n * sizeof *idx);
+        if (idx) {
+            for (i = 0; i < n; ++i)
+                idx[i] = i;
+            SKIPLIST_NAME(_sort_indices)(list, keys, idx, n);
+        }
+    }
+
+    f.started = 0;
+    for (i = 0; i < n; ++i) {
+        j = idx ? idx[i] : i;
+        p = SKIPLIST_NAME(_finger_seek)(list, &f, keys[j], 0);
+        m = SL_NEXT_(p, 0);
+        hit = m != NULL && SL_COMPARE_(list, m->key, keys[j]) == 0;
+        if (m) {
+            /* The next key of a sorted batch is most likely just ahead. */
+            SL_PREFETCH_(SL_NEXT_(m, 0));
+            if (p->height > 1)
+                SL_PREFETCH_(SL_NEXT_(p, 1));
+        }
+        if (hit && out)
+            out[j] = SL_VALUE_(m);
+        if (found)
+            found[j] = hit;
+        hits += hit;
+    }
+
+    if (idx)
+        SKIPLIST_FREE(list->mem_udata, idx);
+    SL_READ_END_(list);
+    return hits;
+}
+
+/* Inserts a pair by resuming the finger's search.
+   @return 1 if the key was added, 0 if it replaced a value, -1 if a node
+   could not be allocated */
+static int SKIPLIST_NAME(_finger_insert)(SL_LIST *list, SKIPLIST_NAME(_finger) *f, SL_KEY key, SL_VAL val, SL_ITER_FN on_replace, void *userdata) {
+    SL_NODE *p, *nn;
+    unsigned long *rank = NULL;
+
+#ifdef SKIPLIST_INDEXED
+    rank = f->rank;
+#endif
+    p = SL_NEXT_(SKIPLIST_NAME(_finger_seek)(list, f, key, SL_DUPS_), 0);
+    if (!SL_DUPS_ && p && SL_COMPARE_(list, p->key, key) == 0) {
+        if (on_replace)
+            on_replace(p->key, SL_VALUE_(p), userdata);
+        return SKIPLIST_NAME(_assign)(list, p, NULL, val, f->update, rank) ? -1 : 0;
+    }
+    nn = SKIPLIST_NAME(_alloc_node)(list, SKIPLIST_NAME(_random_height)(list));
+    if (!nn)
+        return -1;
+    nn->key = key;
+    SL_SET_VALUE_(nn, val);
+    /* The finger's path still leads to key, now at nn. */
+    SKIPLIST_NAME(_link)(list, nn, f->update, rank);
+    return 1;
+}
+
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(insert_sorted_batch)(SL_LIST *list, const SL_KEY *keys, const SL_VAL *vals, unsigned long n, SL_ITER_FN on_replace, void *userdata) {
+    SKIPLIST_NAME(_finger) f;
+    unsigned long i;
+    long added = 0;
+    int r;
+
+    f.started = 0;
+    for (i = 0; i < n; ++i) {
+        if ((r = SKIPLIST_NAME(_finger_insert)(list, &f, keys[i], vals[i], on_replace, userdata)) < 0)
+            return -1;
+        added += r;
+    }
+    return added;
+}
+
+#ifndef SKIPLIST_PERSIST
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(merge)(SL_LIST *dst, SL_LIST *src) {
+    SKIPLIST_NAME(_finger) f;
+    SL_NODE *m, *next, *p;
+    unsigned long *rank = NULL;
+    unsigned int i;
+
+    if (dst == src || src->size == 0)
+        return;
+#ifdef SKIPLIST_POOL
+    SKIPLIST_NAME(_pool_join)(dst, src);
+#endif
+#ifdef SKIPLIST_INDEXED
+    rank = f.rank;
+#endif
+
+    m = SL_NEXT_(src->head, 0);
+    for (i = 0; i < src->highest; ++i)
+        SL_SET_NEXT_(src->head, i, NULL);
+    src->highest = 0;
+    src->size = 0;
+    SL_SET_TAIL_(src, NULL);
+
+    f.started = 0;
+    for (; m; m = next) {
+        next = SL_NEXT_(m, 0);
+        p = SL_NEXT_(SKIPLIST_NAME(_finger_seek)(dst, &f, m->key, SL_DUPS_), 0);
+        if (!SL_DUPS_ && p && SL_COMPARE_(dst, p->key, m->key) == 0)
+            SKIPLIST_NAME(_assign)(dst, p, m, SL_VALUE_(m), f.update, rank);
+        else
+            SKIPLIST_NAME(_link)(dst, m, f.update, rank);
+    }
+}
+#endif
+
+/* Removes the pairs from the first key not less than lo up to the last
+   key less than hi, or not greater than it if `past` is 1. */
+static unsigned long SKIPLIST_NAME(_erase)(SL_LIST *list, SL_KEY lo, SL_KEY hi, int past) {
+    SL_NODE *n, *m, *next, *update[SKIPLIST_MAX_LEVELS], *last[SKIPLIST_MAX_LEVELS];
+    unsigned long count = 0;
+    unsigned int i;
+#ifdef SKIPLIST_INDEXED
+    unsigned long r = 0, rm = 0, ranks[SKIPLIST_MAX_LEVELS], rank_last[SKIPLIST_MAX_LEVELS];
+#endif
+
+    /* Two searches share the descent: n stops before lo and m at the end
+       of the range. On each level m carries on from the further of the
+       two. */
+    SL_STAT_(list, searches);
+    n = m = list->head;
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && SL_COMPARE_(list, next->key, lo) < 0) {
+#ifdef SKIPLIST_INDEXED
+            r += SL_WIDTH_(n, i);
+#endif
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        if (n != list->head && (m == list->head || SL_COMPARE_(list, m->key, n->key) < 0)) {
+            m = n;
+#ifdef SKIPLIST_INDEXED
+            rm = r;
+#endif
+        }
+        while ((next = SL_NEXT_(m, i)) && SL_COMPARE_(list, next->key, hi) < past) {
+#ifdef SKIPLIST_INDEXED
+            rm += SL_WIDTH_(m, i);
+#endif
+            SL_STAT_(list, visits[i]);
+            m = next;
+        }
+        update[i] = n;
+        last[i] = m;
+#ifdef SKIPLIST_INDEXED
+        ranks[i] = r;
+        rank_last[i] = rm;
+#endif
+    }
+    if (n == m)
+        return 0;
+
+    SL_TOUCH_(list);
+    m = SL_NEXT_(n, 0);
+#ifdef SKIPLIST_INDEXED
+    count = rm - r;
+    for (i = 0; i < list->highest; ++i)
+        SL_WIDTH_(update[i], i) = rank_last[i] + SL_WIDTH_(last[i], i) - count - ranks[i];
+#endif
+    for (i = 0; i < list->highest; ++i)
+        SL_SET_NEXT_(update[i], i, SL_NEXT_(last[i], i));
+    if ((next = SL_NEXT_(n, 0)))
+        SL_SET_PREV_(next, n == list->head ? NULL : n);
+    else
+        SL_SET_TAIL_(list, n == list->head ? NULL : n);
+    while (list->highest > 0 && SL_NEXT_(list->head, list->highest - 1) == NULL)
+        --list->highest;
+
+    /* The removed nodes still link to one another on level 0. */
+    for (count = 0; m != next; m = n, ++count) {
+        n = SL_NEXT_(m, 0);
+        SKIPLIST_NAME(_retire_node)(list, m);
+    }
+    list->size -= count;
+    return count;
+}
+
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(erase_range)(SL_LIST *list, SL_KEY lo, SL_KEY hi) {
+    if (SL_COMPARE_(list, lo, hi) >= 0)
+        return 0;
+    return SKIPLIST_NAME(_erase)(list, lo, hi, 0);
+}
+
+#ifdef SKIPLIST_MULTI
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(remove_all)(SL_LIST *list, SL_KEY key) {
+    return SKIPLIST_NAME(_erase)(list, key, key, 1);
+}
+#endif
+
+#ifndef SKIPLIST_PERSIST
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(split)(SL_LIST *list, SL_KEY key, SL_LIST *out) {
+    SL_NODE *n, *next, *update[SKIPLIST_MAX_LEVELS];
+    unsigned long kept, moved;
+    unsigned int i;
+#ifdef SKIPLIST_INDEXED
+    unsigned long r = 0, rank[SKIPLIST_MAX_LEVELS];
+#else
+    SL_NODE *a, *b;
+#endif
+
+    if (out == list)
+        return 0;
+    SL_STAT_(list, searches);
+    n = list->head;
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && SL_COMPARE_(list, next->key, key) < 0) {
+#ifdef SKIPLIST_INDEXED
+            r += SL_WIDTH_(n, i);
+#endif
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        update[i] = n;
+#ifdef SKIPLIST_INDEXED
+        rank[i] = r;
+#endif
+    }
+    if (!SL_NEXT_(n, 0))
+        return 0;
+#ifdef SKIPLIST_POOL
+    SKIPLIST_NAME(_pool_join)(out, list);
+#endif
+
+#ifdef SKIPLIST_INDEXED
+    kept = r;
+#else
+    /* Count outwards from the split point both ways at once, stopping at
+       whichever end comes first. */
+    kept = moved = 0;
+    a = n == list->head ? NULL : n;
+    for (b = SL_NEXT_(n, 0); a && b; a = SL_PREV_(a), b = SL_NEXT_(b, 0)) {
+        ++kept;
+        ++moved;
+    }
+    if (a)
+        kept = list->size - moved;
+#endif
+    moved = list->size - kept;
+
+    for (i = 0; i < list->highest; ++i) {
+        SL_SET_NEXT_(out->head, i, SL_NEXT_(update[i], i));
+#ifdef SKIPLIST_INDEXED
+        SL_WIDTH_(out->head, i) = rank[i] + SL_WIDTH_(update[i], i) - kept;
+        SL_WIDTH_(update[i], i) = kept + 1 - rank[i];
+#endif
+        SL_SET_NEXT_(update[i], i, NULL);
+    }
+    SL_SET_PREV_(SL_NEXT_(out->head, 0), NULL);
+    SL_SET_TAIL_(out, SL_TAIL_(list));
+    out->size = moved;
+    out->highest = list->highest;
+    SL_SET_TAIL_(list, n == list->head ? NULL : n);
+    list->size = kept;
+    while (list->highest > 0 && SL_NEXT_(list->head, list->highest - 1) == NULL)
+        --list->highest;
+    while (out->highest > 0 && SL_NEXT_(out->head, out->highest - 1) == NULL)
+        --out->highest;
+    return moved;
+}
+#endif
+
+/* Returns the last node with a key less than key, searching forward from
+   n, whose own key must be less. The search climbs n's links while the
+   next level up still falls short of key and then descends as usual, so a
+   node d places ahead is reached in O(log d) steps. */
+static SL_NODE *SKIPLIST_NAME(_gallop)(SL_LIST *list, SL_NODE *n, SL_KEY key) {
+    SL_NODE *next;
+    unsigned int i = 0;
+
+    (void)list;
+    SL_STAT_(list, searches);
+    for (;;) {
+        if (i + 1 < n->height && (next = SL_NEXT_(n, i + 1)) && SL_COMPARE_(list, next->key, key) < 0)
+            ++i;
+        else if (!(next = SL_NEXT_(n, i)) || SL_COMPARE_(list, next->key, key) >= 0)
+            break;
+        SL_STAT_(list, visits[i]);
+        n = next;
+    }
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && SL_COMPARE_(list, next->key, key) < 0) {
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+    }
+    return n;
+}
+
+/* Where intersect, union and difference send their pairs. */
+typedef struct {
+    SKIPLIST_NAME(_finger) f;
+    SL_LIST *dst;
+    SL_ITER_FN iter;
+    void *userdata;
+    long count;
+} SKIPLIST_NAME(_sink);
+
+static void SKIPLIST_NAME(_sink_init)(SKIPLIST_NAME(_sink) *s, SL_LIST *dst, SL_ITER_FN iter, void *userdata) {
+    s->f.started = 0;
+    s->dst = dst;
+    s->iter = iter;
+    s->userdata = userdata;
+    s->count = 0;
+}
+
+/* Sends the pairs from n up to but not including stop.
+   @return 0 to carry on, 1 if iter asked to stop, -1 if a node could not
+   be allocated */
+static int SKIPLIST_NAME(_emit)(SKIPLIST_NAME(_sink) *s, SL_NODE *n, SL_NODE *stop) {
+    for (; n != stop; n = SL_NEXT_(n, 0)) {
+        if (s->dst && SKIPLIST_NAME(_finger_insert)(s->dst, &s->f, n->key, SL_VALUE_(n), NULL, NULL) < 0)
+            return -1;
+        ++s->count;
+        if (s->iter && s->iter(n->key, SL_VALUE_(n), s->userdata))
+            return 1;
+    }
+    return 0;
+}
+
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(intersect)(SL_LIST *a, SL_LIST *b, SL_LIST *dst, SL_ITER_FN iter, void *userdata) {
+    SKIPLIST_NAME(_sink) s;
+    SL_NODE *x, *y;
+    int c, r = 0;
+
+    SKIPLIST_NAME(_sink_init)(&s, dst, iter, userdata);
+    x = SL_NEXT_(a->head, 0);
+    y = SL_NEXT_(b->head, 0);
+    while (x && y && !r) {
+        c = SL_COMPARE_(a, x->key, y->key);
+        if (c < 0)
+            x = SL_NEXT_(SKIPLIST_NAME(_gallop)(a, x, y->key), 0);
+        else if (c > 0)
+            y = SL_NEXT_(SKIPLIST_NAME(_gallop)(b, y, x->key), 0);
+        else {
+            r = SKIPLIST_NAME(_emit)(&s, x, SL_NEXT_(x, 0));
+            x = SL_NEXT_(x, 0);
+            y = SL_NEXT_(y, 0);
+        }
+    }
+    return r < 0 ? -1 : s.count;
+}
+
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(union)(SL_LIST *a, SL_LIST *b, SL_LIST *dst, SL_ITER_FN iter, void *userdata) {
+    SKIPLIST_NAME(_sink) s;
+    SL_NODE *x, *y, *stop;
+    int c, r = 0;
+
+    SKIPLIST_NAME(_sink_init)(&s, dst, iter, userdata);
+    x = SL_NEXT_(a->head, 0);
+    y = SL_NEXT_(b->head, 0);
+    /* Runs found by galloping are sent on without comparing each key. */
+    while ((x || y) && !r) {
+        c = !y ? -1 : !x ? 1 : SL_COMPARE_(a, x->key, y->key);
+        if (c < 0) {
+            stop = y ? SL_NEXT_(SKIPLIST_NAME(_gallop)(a, x, y->key), 0) : NULL;
+            r = SKIPLIST_NAME(_emit)(&s, x, stop);
+            x = stop;
+        } else if (c > 0) {
+            stop = x ? SL_NEXT_(SKIPLIST_NAME(_gallop)(b, y, x->key), 0) : NULL;
+            r = SKIPLIST_NAME(_emit)(&s, y, stop);
+            y = stop;
+        } else {
+            r = SKIPLIST_NAME(_emit)(&s, x, SL_NEXT_(x, 0));
+            x = SL_NEXT_(x, 0);
+            y = SL_NEXT_(y, 0);
+        }
+    }
+    return r < 0 ? -1 : s.count;
+}
+
+SKIPLIST_EXTERN
+long SKIPLIST_NAME(difference)(SL_LIST *a, SL_LIST *b, SL_LIST *dst, SL_ITER_FN iter, void *userdata) {
+    SKIPLIST_NAME(_sink) s;
+    SL_NODE *x, *y, *stop;
+    int c, r = 0;
+
+    SKIPLIST_NAME(_sink_init)(&s, dst, iter, userdata);
+    x = SL_NEXT_(a->head, 0);
+    y = SL_NEXT_(b->head, 0);
+    while (x && !r) {
+        c = y ? SL_COMPARE_(a, x->key, y->key) : -1;
+        if (c < 0) {
+            stop = y ? SL_NEXT_(SKIPLIST_NAME(_gallop)(a, x, y->key), 0) : NULL;
+            r = SKIPLIST_NAME(_emit)(&s, x, stop);
+            x = stop;
+        } else if (c > 0)
+            y = SL_NEXT_(SKIPLIST_NAME(_gallop)(b, y, x->key), 0);
+        else {
+            x = SL_NEXT_(x, 0);
+            y = SL_NEXT_(y, 0);
+        }
+    }
+    return r < 0 ? -1 : s.count;
+}
+
+/* Stores x at p as a LEB128 varint and returns the byte after it. */
+static unsigned char *SKIPLIST_NAME(_put_varint)(unsigned char *p, size_t x) {
+    while (x >= 0x80) {
+        *p++ = (unsigned char)(x | 0x80);
+        x >>= 7;
+    }
+    *p++ = (unsigned char)x;
+    return p;
+}
+
+/* Decodes a varint from [*p, end) and moves *p past it.
+   @return 0 if successful, 1 if it runs past end or does not fit a size_t */
+static int SKIPLIST_NAME(_get_varint)(const unsigned char **p, const unsigned char *end, size_t *x) {
+    unsigned int shift = 0;
+    *x = 0;
+    while (*p < end && shift < 8 * sizeof(size_t)) {
+        /* The last byte that fits may only carry the bits still missing. */
+        if (shift + 7 > 8 * sizeof(size_t) && (**p & 0x7F) >> (8 * sizeof(size_t) - shift))
+            return 1;
+        *x |= (size_t)(**p & 0x7F) << shift;
+        if (!(*(*p)++ & 0x80))
+            return 0;
+        shift += 7;
+    }
+    return 1;
+}
+
+static int SKIPLIST_NAME(_write_all)(SL_WRITE_FN write, void *udata, const void *p, size_t len) {
+    return len && write(p, len, udata) != len;
+}
+
+/* Writes a varint followed by len bytes. */
+static int SKIPLIST_NAME(_write_sized)(SL_WRITE_FN write, void *udata, size_t x, const void *p, size_t len) {
+    unsigned char hdr[SL_VARINT_MAX_];
+    return SKIPLIST_NAME(_write_all)(write, udata, hdr, (size_t)(SKIPLIST_NAME(_put_varint)(hdr, x) - hdr)) ||
+           SKIPLIST_NAME(_write_all)(write, udata, p, len);
+}
+
+static int SKIPLIST_NAME(_read_all)(SL_READ_FN read, void *udata, void *p, size_t len) {
+    size_t got;
+    while (len) {
+        if (!(got = read(p, len, udata)))
+            return 1;
+        p = (char *)p + got;
+        len -= got;
+    }
+    return 0;
+}
+
+/* Varints outside blocks are read a byte at a time, so that nothing past
+   the last pair is consumed. */
+static int SKIPLIST_NAME(_read_varint)(SL_READ_FN read, void *udata, size_t *x) {
+    unsigned char buf[SL_VARINT_MAX_];
+    const unsigned char *p = buf;
+    unsigned int i;
+    for (i = 0; i < SL_VARINT_MAX_; ++i) {
+        if (SKIPLIST_NAME(_read_all)(read, udata, buf + i, 1))
+            return 1;
+        if (!(buf[i] & 0x80))
+            return SKIPLIST_NAME(_get_varint)(&p, buf + i + 1, x);
+    }
+    return 1;
+}
+
+/* Reads a length and that many bytes from [*p, end) into a key or value.
+   @return 0 if successful, 1 if they run past end or the hook rejects them */
+#define SL_GET_FIELD_(load, x, p, end, len, udata) \
+    (SKIPLIST_NAME(_get_varint)(&(p), (end), &(len)) || (len) > (size_t)((end) - (p)) || \
+     load((x), (p), (len), (udata)) || ((p) += (len), 0))
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(serialize)(SL_LIST *list, SL_WRITE_FN write, void *udata) {
+    unsigned char buf[SL_BLOCK_], kh[SL_VARINT_MAX_], vh[SL_VARINT_MAX_], *p, *ke, *ve;
+    const void *kb, *vb;
+    size_t klen, vlen, need;
+    SL_NODE *n;
+
+    memcpy(buf, SL_STREAM_MAGIC_, 4);
+    p = SKIPLIST_NAME(_put_varint)(buf + 4, list->size);
+    if (SKIPLIST_NAME(_write_all)(write, udata, buf, (size_t)(p - buf)))
+        return 1;
+
+    p = buf;
+    for (n = SL_NEXT_(list->head, 0); n; n = SL_NEXT_(n, 0)) {
+        kb = SL_KEY_BYTES_(n->key, klen);
+        vb = SL_VAL_BYTES_(SL_VALUE_(n), vlen);
+        ke = SKIPLIST_NAME(_put_varint)(kh, klen);
+        ve = SKIPLIST_NAME(_put_varint)(vh, vlen);
+        need = (size_t)(ke - kh) + klen + (size_t)(ve - vh) + vlen;
+        if (need > SL_BLOCK_ - (size_t)(p - buf)) {
+            if (p > buf && SKIPLIST_NAME(_write_sized)(write, udata, (size_t)(p - buf), buf, (size_t)(p - buf)))
+                return 1;
+            p = buf;
+        }
+        if (need > SL_BLOCK_) {
+            /* Too big for a block, so it gets one to itself. */
+            if (SKIPLIST_NAME(_write_sized)(write, udata, need, kh, (size_t)(ke - kh)) ||
+                SKIPLIST_NAME(_write_all)(write, udata, kb, klen) ||
+                SKIPLIST_NAME(_write_sized)(write, udata, vlen, vb, vlen))
+                return 1;
+            continue;
+        }
+        memcpy(p, kh, (size_t)(ke - kh));
+        p += ke - kh;
+        memcpy(p, kb, klen);
+        p += klen;
+        memcpy(p, vh, (size_t)(ve - vh));
+        p += ve - vh;
+        memcpy(p, vb, vlen);
+        p += vlen;
+    }
+    return p > buf && SKIPLIST_NAME(_write_sized)(write, udata, (size_t)(p - buf), buf, (size_t)(p - buf));
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(deserialize)(SL_LIST *list, SL_READ_FN read, void *udata) {
+    SKIPLIST_NAME(_builder) b;
+    unsigned char stack[SL_BLOCK_], *buf;
+    const unsigned char *p, *end;
+    size_t count, len, klen, vlen;
+    SL_KEY key;
+    SL_VAL val;
+    int err = 0;
+
+    if (SKIPLIST_NAME(_read_all)(read, udata, stack, 4) || memcmp(stack, SL_STREAM_MAGIC_, 4) ||
+        SKIPLIST_NAME(_read_varint)(read, udata, &count))
+        return 1;
+
+    SKIPLIST_NAME(_build_begin)(list, &b);
+    while (count && !err) {
+        if (SKIPLIST_NAME(_read_varint)(read, udata, &len) || len == 0) {
+            err = 1;
+            break;
+        }
+        buf = stack;
+        if (len > SL_BLOCK_ && !(buf = (unsigned char *)SKIPLIST_MALLOC(list->mem_udata, len))) {
+            err = -1;
+            break;
+        }
+        err = SKIPLIST_NAME(_read_all)(read, udata, buf, len);
+        /* Each key is checked against the one before it, so a bad stream
+           never leaves the list out of order. */
+        for (p = buf, end = buf + len; !err && p < end; --count) {
+            if (!count ||
+                SL_GET_FIELD_(SL_KEY_LOAD_, key, p, end, klen, udata) ||
+                SL_GET_FIELD_(SL_VAL_LOAD_, val, p, end, vlen, udata) ||
+                (list->size && SL_COMPARE_(list, b.last[0]->key, key) >= SL_DUPS_))
+                err = 1;
+            else
+                err = SKIPLIST_NAME(_build_push)(list, &b, key, val);
+        }
+        if (buf != stack)
+            SKIPLIST_FREE(list->mem_udata, buf);
+    }
+    SKIPLIST_NAME(_build_end)(list, &b);
+    return err;
+}
+
+#undef SL_GET_FIELD_
+
+SKIPLIST_EXTERN
+SL_VAL SKIPLIST_NAME(get)(SL_LIST *list, SL_KEY key, SL_VAL default_val) {
+    SL_VAL v;
+    if (SKIPLIST_NAME(find)(list, key, &v))
+        return v;
+    return default_val;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(remove)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
+    SL_NODE *n, *next;
+    SL_NODE *update[SKIPLIST_MAX_LEVELS];
+    int cmp;
+    unsigned int i;
+    SL_STAT_(list, removes);
+    SL_STAT_(list, searches);
+    n = list->head;
+    i = list->highest;
+
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && (cmp = SL_COMPARE_(list, next->key, key)) < 0) {
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        update[i] = n;
+    }
+
+    n = SL_NEXT_(n, 0);
+    if (n && (SL_COMPARE_(list, n->key, key) == 0)) {
+      if (out)
+        *out = SL_VALUE_(n);
+      SKIPLIST_NAME(_unlink)(list, n, update);
+      SKIPLIST_NAME(_retire_node)(list, n);
+      return 1;
+    }
+    return 0;
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(iter)(SL_LIST *list, SL_ITER_FN iter, void *userdata) {
+    SL_NODE *n;
+    int stop = 0;
+    SL_READ_BEGIN_(list);
+    n = SL_NEXT_(list->head, 0);
+    while (n && !(stop = iter(n->key, SL_VALUE_(n), userdata)))
+        n = SL_NEXT_(n, 0);
+    SL_READ_END_(list);
+    return stop;
+}
+
+/* Descends to the last node whose key is less than `key`, or not greater
+   than it if `past` is 1. Returns the head if there is no such node. */
+static SL_NODE *SKIPLIST_NAME(_seek)(SL_LIST *list, SL_KEY key, int past) {
+    SL_NODE *n, *next;
+    unsigned int i;
+    SL_STAT_(list, searches);
+    n = list->head;
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && SL_COMPARE_(list, next->key, key) < past) {
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+    }
+    return n;
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(iter_range)(SL_LIST *list, SL_KEY lo, SL_KEY hi, SL_ITER_FN iter, void *userdata) {
+    SL_NODE *n;
+    int stop = 0;
+    SL_READ_BEGIN_(list);
+    n = SL_NEXT_(SKIPLIST_NAME(_seek)(list, lo, 0), 0);
+    while (n && SL_COMPARE_(list, n->key, hi) < 0 && !(stop = iter(n->key, SL_VALUE_(n), userdata)))
+        n = SL_NEXT_(n, 0);
+    SL_READ_END_(list);
+    return stop;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(lower_bound)(SL_LIST *list, SL_KEY key, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_NODE *n;
+    SL_READ_BEGIN_(list);
+    n = SL_NEXT_(SKIPLIST_NAME(_seek)(list, key, 0), 0);
+    if (n) {
+        if (key_out)
+            *key_out = n->key;
+        if (val_out)
+            *val_out = SL_VALUE_(n);
+    }
+    SL_READ_END_(list);
+    return n != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(upper_bound)(SL_LIST *list, SL_KEY key, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_NODE *n;
+    SL_READ_BEGIN_(list);
+    n = SL_NEXT_(SKIPLIST_NAME(_seek)(list, key, 1), 0);
+    if (n) {
+        if (key_out)
+            *key_out = n->key;
+        if (val_out)
+            *val_out = SL_VALUE_(n);
+    }
+    SL_READ_END_(list);
+    return n != NULL;
+}
+
+#ifdef SKIPLIST_MULTI
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(equal_range)(SL_LIST *list, SL_CURSOR *cur, SL_KEY key) {
+    SL_NODE *n, *first;
+    unsigned long count = 0;
+    SL_READ_BEGIN_(list);
+    first = SL_NEXT_(SKIPLIST_NAME(_seek)(list, key, 0), 0);
+    for (n = first; n && SL_COMPARE_(list, n->key, key) == 0; n = SL_NEXT_(n, 0))
+        ++count;
+    SL_READ_END_(list);
+    if (cur)
+        cur->node = first;
+    return count;
+}
+
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(count)(SL_LIST *list, SL_KEY key) {
+    return SKIPLIST_NAME(equal_range)(list, NULL, key);
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(find_all)(SL_LIST *list, SL_KEY key, SL_ITER_FN iter, void *userdata) {
+    SL_NODE *n;
+    int stop = 0;
+    SL_READ_BEGIN_(list);
+    n = SL_NEXT_(SKIPLIST_NAME(_seek)(list, key, 0), 0);
+    while (n && SL_COMPARE_(list, n->key, key) == 0 && !(stop = iter(n->key, SL_VALUE_(n), userdata)))
+        n = SL_NEXT_(n, 0);
+    SL_READ_END_(list);
+    return stop;
+}
+#endif
+
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(size)(SL_LIST *list) {
+    return list->size;
+}
+
+#ifdef SKIPLIST_INDEXED
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(rank)(SL_LIST *list, SL_KEY key, unsigned long *out) {
+    SL_NODE *n, *next;
+    unsigned long r = 0;
+    unsigned int i;
+    SL_STAT_(list, searches);
+    n = list->head;
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && SL_COMPARE_(list, next->key, key) < 0) {
+            r += SL_WIDTH_(n, i);
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+    }
+    if (out)
+        *out = r;
+    return SL_NEXT_(n, 0) != NULL && SL_COMPARE_(list, SL_NEXT_(n, 0)->key, key) == 0;
+}
+
+/* Descends to the node at 1-based position `pos`, filling in update[] with
+   its predecessors if non-NULL. */
+static SL_NODE *SKIPLIST_NAME(_at)(SL_LIST *list, unsigned long pos, SL_NODE **update) {
+    SL_NODE *n, *next;
+    unsigned long r = 0;
+    unsigned int i;
+    SL_STAT_(list, searches);
+    n = list->head;
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && r + SL_WIDTH_(n, i) < pos) {
+            r += SL_WIDTH_(n, i);
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        if (update)
+            update[i] = n;
+    }
+    return SL_NEXT_(n, 0);
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(at)(SL_LIST *list, unsigned long index, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_NODE *n;
+    if (index >= list->size)
+        return 0;
+    n = SKIPLIST_NAME(_at)(list, index + 1, NULL);
+    if (key_out)
+        *key_out = n->key;
+    if (val_out)
+        *val_out = SL_VALUE_(n);
+    return 1;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(remove_at)(SL_LIST *list, unsigned long index, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_NODE *n, *update[SKIPLIST_MAX_LEVELS];
+    if (index >= list->size)
+        return 0;
+    n = SKIPLIST_NAME(_at)(list, index + 1, update);
+    if (key_out)
+        *key_out = n->key;
+    if (val_out)
+        *val_out = SL_VALUE_(n);
+    SKIPLIST_NAME(_unlink)(list, n, update);
+    SKIPLIST_NAME(_retire_node)(list, n);
+    return 1;
+}
+#endif
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_first)(SL_LIST *list, SL_CURSOR *cur) {
+    cur->node = SL_NEXT_(list->head, 0);
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_last)(SL_LIST *list, SL_CURSOR *cur) {
+    cur->node = SL_TAIL_(list);
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_seek)(SL_LIST *list, SL_CURSOR *cur, SL_KEY key) {
+    cur->node = SL_NEXT_(SKIPLIST_NAME(_seek)(list, key, 0), 0);
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_next)(SL_CURSOR *cur) {
+    if (cur->node)
+        cur->node = SL_NEXT_(cur->node, 0);
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_prev)(SL_CURSOR *cur) {
+    if (cur->node)
+        cur->node = SL_PREV_(cur->node);
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_get)(SL_CURSOR *cur, SL_KEY *key_out, SL_VAL *val_out) {
+    if (!cur->node)
+        return 0;
+    if (key_out)
+        *key_out = cur->node->key;
+    if (val_out)
+        *val_out = SL_VALUE_(cur->node);
+    return 1;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(min)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_NODE *first;
+    SL_READ_BEGIN_(list);
+    first = SL_NEXT_(list->head, 0);
+    if (first) {
+        if (key_out)
+            *key_out = first->key;
+        if (val_out)
+            *val_out = SL_VALUE_(first);
+    }
+    SL_READ_END_(list);
+    return first != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(max)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_NODE *last;
+    SL_READ_BEGIN_(list);
+    last = SL_TAIL_(list);
+    if (last) {
+        if (key_out)
+            *key_out = last->key;
+        if (val_out)
+            *val_out = SL_VALUE_(last);
+    }
+    SL_READ_END_(list);
+    return last != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(pop)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    unsigned int i;
+    SL_NODE *first, *update[SKIPLIST_MAX_LEVELS];
+
+    SL_STAT_(list, pops);
+    if (list->size == 0)
+        return 0;
+
+    first = SL_NEXT_(list->head, 0);
+    for (i = 0; i < list->highest; ++i)
+        update[i] = list->head;
+    SKIPLIST_NAME(_unlink)(list, first, update);
+
+    if (key_out)
+        *key_out = first->key;
+    if (val_out)
+        *val_out = SL_VALUE_(first);
+    SKIPLIST_NAME(_retire_node)(list, first);
+    return 1;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(shift)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    unsigned int i;
+    SL_NODE *n, *next, *last, *update[SKIPLIST_MAX_LEVELS];
+    SL_STAT_(list, shifts);
+    if (list->size == 0)
+        return 0;
+
+    /* The tail is known, so find its predecessors by identity rather than
+       by comparing keys. */
+    SL_STAT_(list, searches);
+    last = SL_TAIL_(list);
+    n = list->head;
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = SL_NEXT_(n, i)) && next != last) {
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        update[i] = n;
+    }
+    SKIPLIST_NAME(_unlink)(list, last, update);
+
+    if (key_out)
+        *key_out = last->key;
+    if (val_out)
+        *val_out = SL_VALUE_(last);
+    SKIPLIST_NAME(_retire_node)(list, last);
+    return 1;
+}
+
+#else /* SKIPLIST_FAT_NODES */
+
+/* _link and _unlink count one pair per node. Fat nodes are only linked or
+   unlinked alongside adding or removing exactly one pair, and every other
+   change adjusts list->size itself. */
+
+/* Returns the index of the first key in n that is not less than `key`, or
+   greater than it if `past` is 1. n->count if there is none. */
+#ifdef SKIPLIST_INT_KEYS
+/* Integer keys are counted rather than binary searched: the index is the
+   number of keys before the probe, and counting needs no branches. Each
+   vector compare covers several keys at once. Unsigned keys are compared
+   as signed ones with the top bit flipped. */
+static unsigned int SKIPLIST_NAME(_slot)(SL_LIST *list, SL_NODE *n, SL_KEY key, int past) {
+    unsigned int i = 0, c = 0;
+#ifdef SL_SIMD_
+    unsigned int j;
+    SL_VEC_ probe, flip, k, acc = SL_VZERO_();
+    int32_t sum32[SL_SIMD_ / 4];
+#ifdef SL_SIMD64_
+    int64_t sum64[SL_SIMD_ / 8];
+#endif
+    const int is_unsigned = (SL_KEY)0 < (SL_KEY)-1;
+    if (sizeof(SL_KEY) == 4) {
+        flip = SL_VSET32_(is_unsigned ? INT32_MIN : 0);
+        probe = SL_VXOR_(SL_VSET32_((int32_t)key), flip);
+        for (; i + SL_SIMD_ / 4 <= n->count; i += SL_SIMD_ / 4) {
+            k = SL_VXOR_(SL_VLOAD_(n->keys + i), flip);
+            acc = SL_VSUB32_(acc, past ? SL_VGT32_(k, probe) : SL_VGT32_(probe, k));
+        }
+        SL_VSTORE_(sum32, acc);
+        for (j = 0; j < SL_SIMD_ / 4; ++j)
+            c += sum32[j];
+    }
+#ifdef SL_SIMD64_
+    else if (sizeof(SL_KEY) == 8) {
+        flip = SL_VSET64_(is_unsigned ? INT64_MIN : 0);
+        probe = SL_VXOR_(SL_VSET64_((int64_t)key), flip);
+        for (; i + SL_SIMD_ / 8 <= n->count; i += SL_SIMD_ / 8) {
+            k = SL_VXOR_(SL_VLOAD_(n->keys + i), flip);
+            acc = SL_VSUB64_(acc, past ? SL_VGT64_(k, probe) : SL_VGT64_(probe, k));
+        }
+        SL_VSTORE_(sum64, acc);
+        for (j = 0; j < SL_SIMD_ / 8; ++j)
+            c += (unsigned int)sum64[j];
+    }
+#endif
+    /* With `past`, the vectors counted the keys above the probe. */
+    if (past)
+        c = i - c;
+#endif
+    (void)list;
+    for (; i < n->count; ++i)
+        c += past ? !(key < n->keys[i]) : n->keys[i] < key;
+    return c;
+}
+#else
+static unsigned int SKIPLIST_NAME(_slot)(SL_LIST *list, SL_NODE *n, SL_KEY key, int past) {
+    unsigned int lo = 0, hi = n->count, mid;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (SL_COMPARE_(list, n->keys[mid], key) < past)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+#endif
+
+/* Descends to the last node whose first key is less than `key`, or not
+   greater than it if `past` is 1, storing the last node visited on each
+   level in update if it is non-NULL. Returns the head if there is no such
+   node. */
+static SL_NODE *SKIPLIST_NAME(_seek)(SL_LIST *list, SL_KEY key, int past, SL_NODE **update) {
+    SL_NODE *n, *next;
+    unsigned int i;
+    SL_STAT_(list, searches);
+    n = list->head;
+    i = list->highest;
+    while (i --> 0) {
+        while ((next = n->next[i]) && SL_COMPARE_(list, next->keys[0], key) < past) {
+            SL_STAT_(list, visits[i]);
+            n = next;
+        }
+        if (update)
+            update[i] = n;
+    }
+    return n;
+}
+
+/* Positions cur on the first pair whose key is not less than `key`, or
+   greater than it if `past` is 1. */
+static short SKIPLIST_NAME(_bound)(SL_LIST *list, SL_CURSOR *cur, SL_KEY key, int past) {
+    SL_NODE *n = SKIPLIST_NAME(_seek)(list, key, 1, NULL);
+    unsigned int i = n == list->head ? 0 : SKIPLIST_NAME(_slot)(list, n, key, past);
+    if (i == n->count) {
+        n = n->next[0];
+        i = 0;
+    }
+    cur->node = n;
+    cur->index = i;
+    return n != NULL;
+}
+
+static void SKIPLIST_NAME(_put)(SL_NODE *n, unsigned int i, SL_KEY key, SL_VAL val) {
+#ifdef SL_SET_
+    (void)n;
+    (void)val;
+#endif
+    memmove(n->keys + i + 1, n->keys + i, (n->count - i) * sizeof(SL_KEY));
+    SL_MOVE_VALUES_(n->vals + i + 1, n->vals + i, n->count - i);
+    n->keys[i] = key;
+    SL_SET_VALUE_AT_(n, i, val);
+    ++n->count;
+}
+
+static void SKIPLIST_NAME(_take)(SL_NODE *n, unsigned int i) {
+    --n->count;
+    memmove(n->keys + i, n->keys + i + 1, (n->count - i) * sizeof(SL_KEY));
+    SL_MOVE_VALUES_(n->vals + i, n->vals + i + 1, n->count - i);
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(insert)(SL_LIST *list, SL_KEY key, SL_VAL val, SL_VAL *prior) {
+    SL_NODE *n, *nn, *update[SKIPLIST_MAX_LEVELS];
+    unsigned int i = 0, half = SKIPLIST_FAT_NODES / 2;
+
+    SL_STAT_(list, inserts);
+    n = SKIPLIST_NAME(_seek)(list, key, 1, update);
+    if (n != list->head) {
+        i = SKIPLIST_NAME(_slot)(list, n, key, 0);
+        if (i < n->count && SL_COMPARE_(list, n->keys[i], key) == 0) {
+            if (prior)
+                *prior = SL_VALUE_AT_(n, i);
+            SL_SET_VALUE_AT_(n, i, val);
+            return 1;
+        }
+    }
+    else if ((n = list->head->next[0])) {
+        /* Smaller than every key: it becomes the first node's first key,
+           and if that node splits the new half goes right after it. */
+        for (i = 0; i < n->height; ++i)
+            update[i] = n;
+        i = 0;
+    }
+
+    if (n && n->count < SKIPLIST_FAT_NODES) {
+        SKIPLIST_NAME(_put)(n, i, key, val);
+        ++list->size;
+        return 0;
+    }
+
+    nn = SKIPLIST_NAME(_alloc_node)(list, SKIPLIST_NAME(_random_height)(list));
+    if (!nn)
+        return -1;
+    nn->count = 0;
+    if (!n || i == n->count) {
+        /* Appending to a full node starts a new one instead of splitting,
+           so keys inserted in increasing order fill every node. */
+        SKIPLIST_NAME(_put)(nn, 0, key, val);
+    }
+    else {
+        memcpy(nn->keys, n->keys + half, (SKIPLIST_FAT_NODES - half) * sizeof(SL_KEY));
+        SL_MOVE_VALUES_(nn->vals, n->vals + half, SKIPLIST_FAT_NODES - half);
+        nn->count = SKIPLIST_FAT_NODES - half;
+        n->count = half;
+        if (i <= half)
+            SKIPLIST_NAME(_put)(n, i, key, val);
+        else
+            SKIPLIST_NAME(_put)(nn, i - half, key, val);
+    }
+    SKIPLIST_NAME(_link)(list, nn, update, NULL);
+    return 0;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(find)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
+    SL_NODE *n;
+    unsigned int i;
+    SL_STAT_(list, finds);
+    n = SKIPLIST_NAME(_seek)(list, key, 1, NULL);
+    if (n == list->head)
+        return 0;
+    i = SKIPLIST_NAME(_slot)(list, n, key, 0);
+    if (i == n->count || SL_COMPARE_(list, n->keys[i], key) != 0)
+        return 0;
+    if (out)
+        *out = SL_VALUE_AT_(n, i);
+    return 1;
+}
+
+SKIPLIST_EXTERN
+SL_VAL SKIPLIST_NAME(get)(SL_LIST *list, SL_KEY key, SL_VAL default_val) {
+    SL_VAL v;
+    if (SKIPLIST_NAME(find)(list, key, &v))
+        return v;
+    return default_val;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(remove)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
+    SL_NODE *n, *next, *update[SKIPLIST_MAX_LEVELS];
+    unsigned int i;
+
+    SL_STAT_(list, removes);
+    /* update ends up holding the predecessors of the node whose first key
+       is `key`, if there is one. */
+    n = SKIPLIST_NAME(_seek)(list, key, 0, update);
+    next = n->next[0];
+    if (next && SL_COMPARE_(list, next->keys[0], key) == 0) {
+        n = next;
+        i = 0;
+        if (n->count == 1) {
+            if (out)
+                *out = SL_VALUE_AT_(n, 0);
+            SKIPLIST_NAME(_unlink)(list, n, update);
+            SKIPLIST_NAME(_retire_node)(list, n);
+            return 1;
+        }
+    }
+    else if (n == list->head)
+        return 0;
+    else {
+        i = SKIPLIST_NAME(_slot)(list, n, key, 0);
+        if (i == n->count || SL_COMPARE_(list, n->keys[i], key) != 0)
+            return 0;
+    }
+
+    if (out)
+        *out = SL_VALUE_AT_(n, i);
+    SKIPLIST_NAME(_take)(n, i);
+
+    /* Fold the next node in once both fit in half a node, so that removals
+       do not leave runs of nearly empty nodes behind. Stopping at half
+       keeps a split and a merge from following each other around. */
+    next = n->next[0];
+    if (next && n->count + next->count <= SKIPLIST_FAT_NODES / 2) {
+        memcpy(n->keys + n->count, next->keys, next->count * sizeof(SL_KEY));
+        SL_MOVE_VALUES_(n->vals + n->count, next->vals, next->count);
+        n->count += next->count;
+        for (i = 0; i < n->height; ++i)
+            update[i] = n;
+        SKIPLIST_NAME(_unlink)(list, next, update);
+        SKIPLIST_NAME(_retire_node)(list, next);
+    }
+    else
+        --list->size;
+    return 1;
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(iter)(SL_LIST *list, SL_ITER_FN iter, void *userdata) {
+    SL_NODE *n;
+    unsigned int i;
+    int stop;
+    for (n = list->head->next[0]; n; n = n->next[0]) {
+        for (i = 0; i < n->count; ++i) {
+            if ((stop = iter(n->keys[i], SL_VALUE_AT_(n, i), userdata)))
+                return stop;
+        }
+    }
+    return 0;
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(iter_range)(SL_LIST *list, SL_KEY lo, SL_KEY hi, SL_ITER_FN iter, void *userdata) {
+    SL_CURSOR cur;
+    int stop;
+    if (!SKIPLIST_NAME(_bound)(list, &cur, lo, 0))
+        return 0;
+    do {
+        if (SL_COMPARE_(list, cur.node->keys[cur.index], hi) >= 0)
+            break;
+        if ((stop = iter(cur.node->keys[cur.index], SL_VALUE_AT_(cur.node, cur.index), userdata)))
+            return stop;
+    } while (SKIPLIST_NAME(cursor_next)(&cur));
     return 0;
 }
 
 SKIPLIST_EXTERN
-void SKIPLIST_NAME(free)(SL_LIST *list) {
-    SL_NODE *n, *next;
-    n = list->head;
-    while (n) {
-        next = n->next[0];
-        SKIPLIST_FREE(list->mem_udata, n);
-        n = next;
+short SKIPLIST_NAME(lower_bound)(SL_LIST *list, SL_KEY key, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_CURSOR cur;
+    SKIPLIST_NAME(_bound)(list, &cur, key, 0);
+    return SKIPLIST_NAME(cursor_get)(&cur, key_out, val_out);
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(upper_bound)(SL_LIST *list, SL_KEY key, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_CURSOR cur;
+    SKIPLIST_NAME(_bound)(list, &cur, key, 1);
+    return SKIPLIST_NAME(cursor_get)(&cur, key_out, val_out);
+}
+
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(size)(SL_LIST *list) {
+    return list->size;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_first)(SL_LIST *list, SL_CURSOR *cur) {
+    cur->node = list->head->next[0];
+    cur->index = 0;
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_last)(SL_LIST *list, SL_CURSOR *cur) {
+    cur->node = list->tail;
+    cur->index = cur->node ? cur->node->count - 1 : 0;
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_seek)(SL_LIST *list, SL_CURSOR *cur, SL_KEY key) {
+    return SKIPLIST_NAME(_bound)(list, cur, key, 0);
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_next)(SL_CURSOR *cur) {
+    if (cur->node && ++cur->index == cur->node->count) {
+        cur->node = cur->node->next[0];
+        cur->index = 0;
+    }
+    return cur->node != NULL;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(cursor_prev)(SL_CURSOR *cur) {
+    if (cur->node) {
+        if (cur->index > 0)
+            --cur->index;
+        else if ((cur->node = cur->node->prev))
+            cur->index = cur->node->count - 1;
     }
+    return cur->node != NULL;
 }
 
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(insert)(SL_LIST *list, SL_KEY key, SL_VAL val, SL_VAL *prior) {
-    SL_NODE *n, *nn, *update[SKIPLIST_MAX_LEVELS];
-    int r;
+short SKIPLIST_NAME(cursor_get)(SL_CURSOR *cur, SL_KEY *key_out, SL_VAL *val_out) {
+    if (!cur->node)
+        return 0;
+    if (key_out)
+        *key_out = cur->node->keys[cur->index];
+    if (val_out)
+        *val_out = SL_VALUE_AT_(cur->node, cur->index);
+    return 1;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(min)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_CURSOR cur;
+    SKIPLIST_NAME(cursor_first)(list, &cur);
+    return SKIPLIST_NAME(cursor_get)(&cur, key_out, val_out);
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(max)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    SL_CURSOR cur;
+    SKIPLIST_NAME(cursor_last)(list, &cur);
+    return SKIPLIST_NAME(cursor_get)(&cur, key_out, val_out);
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(pop)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
     unsigned int i;
-    short replaced;
+    SL_NODE *first, *update[SKIPLIST_MAX_LEVELS];
 
-    n = list->head;
-    nn = (SL_NODE *)SKIPLIST_MALLOC(list->mem_udata, sizeof(SL_NODE));
-    nn->key = key;
-    nn->val = val;
-    memset(nn->next, 0, SKIPLIST_MAX_LEVELS * sizeof(SL_NODE *));
+    SL_STAT_(list, pops);
+    if (list->size == 0)
+        return 0;
 
-    for (r = 0, i = 0; !(r & 1); ++i) {
-        if (r == 0)
-            r = SKIPLIST_RAND(list->rand_udata);
-        r >>= 1;
+    first = list->head->next[0];
+    if (key_out)
+        *key_out = first->keys[0];
+    if (val_out)
+        *val_out = SL_VALUE_AT_(first, 0);
+    if (first->count > 1) {
+        SKIPLIST_NAME(_take)(first, 0);
+        --list->size;
+        return 1;
+    }
+    for (i = 0; i < list->highest; ++i)
+        update[i] = list->head;
+    SKIPLIST_NAME(_unlink)(list, first, update);
+    SKIPLIST_NAME(_retire_node)(list, first);
+    return 1;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(shift)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    unsigned int i;
+    SL_NODE *n, *last, *update[SKIPLIST_MAX_LEVELS];
+    SL_STAT_(list, shifts);
+    if (list->size == 0)
+        return 0;
+
+    last = list->tail;
+    if (key_out)
+        *key_out = last->keys[last->count - 1];
+    if (val_out)
+        *val_out = SL_VALUE_AT_(last, last->count - 1);
+    if (last->count > 1) {
+        --last->count;
+        --list->size;
+        return 1;
     }
-    nn->height = i;
 
+    SL_STAT_(list, searches);
+    n = list->head;
     i = list->highest;
     while (i --> 0) {
-        while (n->next[i] && list->cmp(key, n->next[i]->key, list->cmp_udata) > 0)
+        while (n->next[i] && n->next[i] != last) {
+            SL_STAT_(list, visits[i]);
             n = n->next[i];
+        }
         update[i] = n;
     }
+    SKIPLIST_NAME(_unlink)(list, last, update);
+    SKIPLIST_NAME(_retire_node)(list, last);
+    return 1;
+}
 
-    replaced = n->next[0] != NULL && list->cmp(key, n->next[0]->key, list->cmp_udata) == 0;
-    if (replaced) {
-        if (prior)
-            *prior = n->next[0]->val;
-        n->next[0]->val = val;
-        SKIPLIST_FREE(list->mem_udata, nn);
-    }
-    else {
-        while (nn->height > list->highest)
-            update[list->highest++] = list->head;
+#endif /* SKIPLIST_FAT_NODES */
 
-        i = nn->height;
-        while (i --> 0) {
-            nn->next[i] = update[i]->next[i];
-            update[i]->next[i] = nn;
-        }
+#ifdef SKIPLIST_STATS
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(stats)(SL_LIST *list, SL_STATS *out) {
+    SL_NODE *n;
+    unsigned long searched = 0;
+    unsigned int i;
+    /* Slab and file nodes take their rounded up size */
+#if defined(SKIPLIST_POOL) || defined(SKIPLIST_PERSIST)
+#define SL_BYTES_(h) SL_ALIGN_UP_(SL_NODE_SIZE(h))
+#else
+#define SL_BYTES_(h) SL_NODE_SIZE(h)
+#endif
+    *out = list->stats;
+    memset(out->heights, 0, sizeof out->heights);
+    out->highest = list->highest;
+    out->size = list->size;
+    out->bytes = SL_BYTES_(SKIPLIST_MAX_LEVELS);
+    for (n = SL_NEXT_(list->head, 0); n; n = SL_NEXT_(n, 0)) {
+        ++out->heights[n->height - 1];
+        out->bytes += SL_BYTES_(n->height);
     }
+#undef SL_BYTES_
+    for (i = 0; i < SKIPLIST_MAX_LEVELS; ++i)
+        searched += out->visits[i];
+    out->avg_path = out->searches ? (double)searched / out->searches : 0;
+}
+
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(stats_reset)(SL_LIST *list) {
+    memset(&list->stats, 0, sizeof list->stats);
+}
+#endif
 
-    list->size += !replaced;
+#ifdef SKIPLIST_SWMR
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(read_lock)(SL_LIST *list) {
+    return SKIPLIST_NAME(_enter)(list, SKIPLIST_NAME(_stripe_of)(list));
+}
 
-    return replaced;
+SKIPLIST_EXTERN
+void SKIPLIST_NAME(read_unlock)(SL_LIST *list, unsigned long token) {
+    atomic_fetch_sub_explicit(&SKIPLIST_NAME(_stripe_of)(list)->active[token % 3], 1, memory_order_release);
 }
 
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(find)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
-    SL_NODE *n;
-    int cmp;
-    unsigned int i;
-    n = list->head;
-    i = list->highest;
+void SKIPLIST_NAME(synchronize)(SL_LIST *list) {
+    /* Each advance frees what was retired two epochs back. */
+    while (list->limbo[0] || list->limbo[1] || list->limbo[2])
+        SKIPLIST_NAME(_reclaim)(list);
+}
+#endif
 
-    while (i --> 0) {
-        while (n->next[i]) {
-            if ((cmp = list->cmp(key, n->next[i]->key, list->cmp_udata)) == 0)
-                goto found;
-            else if (cmp < 0)
-                break;
-            n = n->next[i];
+#ifdef SKIPLIST_SHARDED
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(sharded_init)(SL_SHARDED *s, unsigned int count, SL_SPLIT_FN split, void *split_udata, SL_CMP_FN cmp, void *cmp_udata, void **mem_udata, void **rand_udata) {
+    unsigned int i;
+    s->count = count;
+    s->split = split;
+    s->split_udata = split_udata;
+    s->mem_udata = mem_udata ? mem_udata[0] : NULL;
+    s->shards = (SKIPLIST_NAME(_shard) *)SKIPLIST_MALLOC(s->mem_udata, count * sizeof(SKIPLIST_NAME(_shard)));
+    s->cursors = (SL_CURSOR *)SKIPLIST_MALLOC(s->mem_udata, count * sizeof(SL_CURSOR));
+    s->heap = (unsigned int *)SKIPLIST_MALLOC(s->mem_udata, count * sizeof(unsigned int));
+    if (!s->shards || !s->cursors || !s->heap)
+        goto fail;
+    for (i = 0; i < count; ++i) {
+        if (SKIPLIST_LOCK_INIT(&s->shards[i].lock))
+            goto fail_shards;
+        if (SKIPLIST_NAME(init)(&s->shards[i].list, cmp, cmp_udata,
+                                mem_udata ? mem_udata[i] : NULL,
+                                rand_udata ? rand_udata[i] : NULL)) {
+            SKIPLIST_LOCK_FREE(&s->shards[i].lock);
+            goto fail_shards;
         }
     }
     return 0;
 
-    found:
-    if (out)
-        *out = n->next[i]->val;
+fail_shards:
+    while (i--) {
+        SKIPLIST_NAME(free)(&s->shards[i].list);
+        SKIPLIST_LOCK_FREE(&s->shards[i].lock);
+    }
+fail:
+    if (s->shards)
+        SKIPLIST_FREE(s->mem_udata, s->shards);
+    if (s->cursors)
+        SKIPLIST_FREE(s->mem_udata, s->cursors);
+    if (s->heap)
+        SKIPLIST_FREE(s->mem_udata, s->heap);
     return 1;
 }
 
 SKIPLIST_EXTERN
-SL_VAL SKIPLIST_NAME(get)(SL_LIST *list, SL_KEY key, SL_VAL default_val) {
+void SKIPLIST_NAME(sharded_free)(SL_SHARDED *s) {
+    unsigned int i;
+    for (i = 0; i < s->count; ++i) {
+        SKIPLIST_NAME(free)(&s->shards[i].list);
+        SKIPLIST_LOCK_FREE(&s->shards[i].lock);
+    }
+    SKIPLIST_FREE(s->mem_udata, s->shards);
+    SKIPLIST_FREE(s->mem_udata, s->cursors);
+    SKIPLIST_FREE(s->mem_udata, s->heap);
+}
+
+#define SL_SHARD_(s, key) (&(s)->shards[(s)->split((key), (s)->count, (s)->split_udata)])
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(sharded_insert)(SL_SHARDED *s, SL_KEY key, SL_VAL val, SL_VAL *prior) {
+    SKIPLIST_NAME(_shard) *sh = SL_SHARD_(s, key);
+    short r;
+    SKIPLIST_LOCK(&sh->lock);
+    r = SKIPLIST_NAME(insert)(&sh->list, key, val, prior);
+    SKIPLIST_UNLOCK(&sh->lock);
+    return r;
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(sharded_find)(SL_SHARDED *s, SL_KEY key, SL_VAL *out) {
+    SKIPLIST_NAME(_shard) *sh = SL_SHARD_(s, key);
+    short r;
+    SKIPLIST_LOCK(&sh->lock);
+    r = SKIPLIST_NAME(find)(&sh->list, key, out);
+    SKIPLIST_UNLOCK(&sh->lock);
+    return r;
+}
+
+SKIPLIST_EXTERN
+SL_VAL SKIPLIST_NAME(sharded_get)(SL_SHARDED *s, SL_KEY key, SL_VAL default_val) {
     SL_VAL v;
-    if (SKIPLIST_NAME(find)(list, key, &v))
-        return v;
-    return default_val;
+    return SKIPLIST_NAME(sharded_find)(s, key, &v) ? v : default_val;
 }
 
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(remove)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
-    SL_NODE *n;
-    SL_NODE *update[SKIPLIST_MAX_LEVELS];
-    int cmp;
+short SKIPLIST_NAME(sharded_remove)(SL_SHARDED *s, SL_KEY key, SL_VAL *out) {
+    SKIPLIST_NAME(_shard) *sh = SL_SHARD_(s, key);
+    short r;
+    SKIPLIST_LOCK(&sh->lock);
+    r = SKIPLIST_NAME(remove)(&sh->list, key, out);
+    SKIPLIST_UNLOCK(&sh->lock);
+    return r;
+}
+
+#undef SL_SHARD_
+
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(sharded_size)(SL_SHARDED *s) {
+    unsigned long size = 0;
     unsigned int i;
-    n = list->head;
-    i = list->highest;
+    for (i = 0; i < s->count; ++i) {
+        SKIPLIST_LOCK(&s->shards[i].lock);
+        size += s->shards[i].list.size;
+        SKIPLIST_UNLOCK(&s->shards[i].lock);
+    }
+    return size;
+}
+
+#ifdef SKIPLIST_FAT_NODES
+#define SL_CURSOR_KEY_(c) ((c)->node->keys[(c)->index])
+#else
+#define SL_CURSOR_KEY_(c) ((c)->node->key)
+#endif
+
+/* Restores the heap property below heap[i], given n entries. A key lives
+   in exactly one shard, so cursors never tie. */
+static void SKIPLIST_NAME(_sift_down)(SL_SHARDED *s, unsigned int i, unsigned int n) {
+    SL_LIST *list = &s->shards[0].list;
+    unsigned int *heap = s->heap, c, top = heap[i];
+    for (; (c = 2 * i + 1) < n; i = c) {
+        if (c + 1 < n && SL_COMPARE_(list, SL_CURSOR_KEY_(&s->cursors[heap[c + 1]]), SL_CURSOR_KEY_(&s->cursors[heap[c]])) < 0)
+            ++c;
+        if (SL_COMPARE_(list, SL_CURSOR_KEY_(&s->cursors[heap[c]]), SL_CURSOR_KEY_(&s->cursors[top])) >= 0)
+            break;
+        heap[i] = heap[c];
+    }
+    heap[i] = top;
+}
+
+#undef SL_CURSOR_KEY_
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(sharded_iter)(SL_SHARDED *s, SL_ITER_FN iter, void *userdata) {
+    unsigned int i, n = 0;
+    int stop = 0;
+    SL_KEY key;
+    SL_VAL val;
+    /* Always lock in shard order so that concurrent iterations cannot
+       deadlock. */
+    for (i = 0; i < s->count; ++i) {
+        SKIPLIST_LOCK(&s->shards[i].lock);
+        if (SKIPLIST_NAME(cursor_first)(&s->shards[i].list, &s->cursors[i]))
+            s->heap[n++] = i;
+    }
+    for (i = n / 2; i-- > 0;)
+        SKIPLIST_NAME(_sift_down)(s, i, n);
+    while (n && !stop && SKIPLIST_NAME(cursor_get)(&s->cursors[s->heap[0]], &key, &val)) {
+        stop = iter(key, val, userdata);
+        if (!SKIPLIST_NAME(cursor_next)(&s->cursors[s->heap[0]]))
+            s->heap[0] = s->heap[--n];
+        SKIPLIST_NAME(_sift_down)(s, 0, n);
+    }
+    for (i = s->count; i-- > 0;)
+        SKIPLIST_UNLOCK(&s->shards[i].lock);
+    return stop;
+}
+#endif
 
+#else /* SKIPLIST_CONCURRENT */
+
+/* The lock-free list follows Herlihy and Shavit's LockFreeSkipList, after
+   Fraser: removal marks a node's links from the top level down, and the
+   mark on next[0] decides which remover wins. Searches that modify the
+   list unlink any marked nodes they pass; find never writes at all.
+
+   Memory is reclaimed by epochs. Every operation runs inside a critical
+   section tagged with the global epoch it started in, and nodes retired
+   in epoch e are freed when the epoch advances from e + 1 to e + 2, which
+   can only happen once nobody who entered before e + 1 is still inside. */
+
+#define SL_REF_(p) ((SL_NODE *)((p) & ~(uintptr_t)1))
+#define SL_MARKED_(p) ((p) & 1)
+#define SL_LOAD_(p) atomic_load_explicit((p), memory_order_acquire)
+
+/* Tries to move the epoch from `e` on, freeing what was retired two epochs
+   ago. Must be called from inside a critical section entered in `e`, which
+   keeps the epoch from advancing again until the frees are done. */
+static void SKIPLIST_NAME(_advance)(SL_LIST *list, unsigned long e) {
+    SL_NODE *n, *next;
+    unsigned int i;
+    for (i = 0; i < SKIPLIST_EPOCH_STRIPES; ++i) {
+        if (atomic_load(&list->stripes[i].active[(e + 2) % 3]))
+            return;
+    }
+    if (!atomic_compare_exchange_strong(&list->epoch, &e, e + 1))
+        return;
+    n = atomic_exchange(&list->limbo[(e + 2) % 3], NULL);
+    while (n) {
+        next = n->retired;
+        SKIPLIST_NAME(_free_node)(list, n);
+        n = next;
+    }
+}
+
+static void SKIPLIST_NAME(_leave)(SL_LIST *list, SKIPLIST_NAME(_stripe) *s, unsigned long e) {
+    if ((atomic_fetch_add_explicit(&s->ops, 1, memory_order_relaxed) & 63) == 63)
+        SKIPLIST_NAME(_advance)(list, e);
+    atomic_fetch_sub(&s->active[e % 3], 1);
+}
+
+static void SKIPLIST_NAME(_release)(SL_LIST *list, SL_NODE *n) {
+    unsigned long e;
+    SL_NODE *head;
+    if (atomic_fetch_sub(&n->refs, 1) != 1)
+        return;
+    e = atomic_load(&list->epoch);
+    head = atomic_load(&list->limbo[e % 3]);
+    do
+        n->retired = head;
+    while (!atomic_compare_exchange_weak(&list->limbo[e % 3], &head, n));
+}
+
+/* Fills `preds` and `succs` with the neighbours `key` has or would have on
+   each level, unlinking marked nodes along the way. succs[i] is the first
+   unmarked node not less than `key`.
+   @return 1 if succs[0] holds `key`, 0 if not */
+static int SKIPLIST_NAME(_find)(SL_LIST *list, SL_KEY key, SL_NODE **preds, SL_NODE **succs) {
+    unsigned int i;
+    uintptr_t next, expected;
+    SL_NODE *pred, *curr;
+retry:
+    pred = list->head;
+    succs[0] = NULL;
+    i = atomic_load(&list->highest);
     while (i --> 0) {
-        while (n->next[i] && (cmp = list->cmp(n->next[i]->key, key, list->cmp_udata)) < 0) {
-            n = n->next[i];
+        curr = SL_REF_(SL_LOAD_(&pred->next[i]));
+        while (curr) {
+            next = SL_LOAD_(&curr->next[i]);
+            if (SL_MARKED_(next)) {
+                expected = (uintptr_t)curr;
+                if (!atomic_compare_exchange_strong(&pred->next[i], &expected, next & ~(uintptr_t)1))
+                    goto retry;
+                curr = SL_REF_(next);
+                continue;
+            }
+            if (SL_COMPARE_(list, curr->key, key) >= 0)
+                break;
+            pred = curr;
+            curr = SL_REF_(next);
         }
-        update[i] = n;
+        preds[i] = pred;
+        succs[i] = curr;
     }
+    return succs[0] && SL_COMPARE_(list, succs[0]->key, key) == 0;
+}
 
-    n = n->next[0];
-    if (n && (list->cmp(n->key, key, list->cmp_udata) == 0) && out) {
-      *out = n->val;
-      i = 0;
-      while (i < list->highest) {
-        if (update[i]->next[i] != n) break;
-        update[i]->next[i] = n->next[i];
-        i++;
-      }
-      SKIPLIST_FREE(list->mem_udata, n);
-      while (list->highest > 0 && list->head->next[list->highest - 1] == NULL) {
-        --list->highest;
-      }
-      --list->size;
-      return 1;
+/* Like _find, but only reads. Marked nodes are stepped over instead of
+   unlinked.
+   @return the first unmarked node not less than `key`, or NULL */
+static SL_NODE *SKIPLIST_NAME(_search)(SL_LIST *list, SL_KEY key) {
+    unsigned int i;
+    uintptr_t next;
+    SL_NODE *pred = list->head, *curr = NULL;
+    i = atomic_load_explicit(&list->highest, memory_order_relaxed);
+    while (i --> 0) {
+        curr = SL_REF_(SL_LOAD_(&pred->next[i]));
+        while (curr) {
+            next = SL_LOAD_(&curr->next[i]);
+            if (!SL_MARKED_(next)) {
+                if (SL_COMPARE_(list, curr->key, key) >= 0)
+                    break;
+                pred = curr;
+            }
+            curr = SL_REF_(next);
+        }
     }
+    return curr;
+}
+
+static SL_NODE *SKIPLIST_NAME(_first)(SL_LIST *list) {
+    uintptr_t next;
+    SL_NODE *n = SL_REF_(SL_LOAD_(&list->head->next[0]));
+    while (n && SL_MARKED_(next = SL_LOAD_(&n->next[0])))
+        n = SL_REF_(next);
+    return n;
+}
+
+/* Marks every level of a node, top down.
+   @return 1 if this call marked next[0], and so removed the node */
+static int SKIPLIST_NAME(_mark)(SL_NODE *n) {
+    unsigned int i = n->height;
+    while (i --> 1)
+        atomic_fetch_or(&n->next[i], 1);
+    return !SL_MARKED_(atomic_fetch_or(&n->next[0], 1));
+}
+
+/* Finishes a removal won by _mark: unlinks the node and drops the
+   remover's reference. */
+static void SKIPLIST_NAME(_unlink)(SL_LIST *list, SL_NODE *n) {
+    SL_NODE *preds[SKIPLIST_MAX_LEVELS], *succs[SKIPLIST_MAX_LEVELS];
+    atomic_fetch_sub(&list->size, 1);
+    SKIPLIST_NAME(_find)(list, n->key, preds, succs);
+    SKIPLIST_NAME(_release)(list, n);
+}
+
+SKIPLIST_EXTERN
+int SKIPLIST_NAME(init)(SL_LIST *list, SL_CMP_FN cmp, void *cmp_udata, void *mem_udata, void *rand_udata) {
+    unsigned int i;
+    list->cmp = cmp;
+    list->cmp_udata = cmp_udata;
+    list->mem_udata = mem_udata;
+    list->rand_udata = rand_udata;
+#ifdef SL_BUILTIN_RAND_
+    list->rng = (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)list;
+#else
+    SKIPLIST_SRAND(rand_udata);
+#endif
+    atomic_init(&list->size, 0);
+    atomic_init(&list->highest, 0);
+    atomic_init(&list->epoch, 0);
+    for (i = 0; i < 3; ++i)
+        atomic_init(&list->limbo[i], NULL);
+    memset(list->stripes, 0, sizeof list->stripes);
+    list->head = SKIPLIST_NAME(_alloc_node)(list, SKIPLIST_MAX_LEVELS);
+    if (!list->head)
+        return 1;
+    atomic_init(&list->head->refs, 1);
+    for (i = 0; i < SKIPLIST_MAX_LEVELS; ++i)
+        atomic_init(&list->head->next[i], 0);
     return 0;
 }
 
 SKIPLIST_EXTERN
-int SKIPLIST_NAME(iter)(SL_LIST *list, SL_ITER_FN iter, void *userdata) {
-    SL_NODE *n;
-    int stop;
-    n = list->head;
-    while (n->next[0]) {
-        if ((stop = iter(n->next[0]->key, n->next[0]->val, userdata)))
-            return stop;
-        n = n->next[0];
+void SKIPLIST_NAME(free)(SL_LIST *list) {
+    SL_NODE *n, *next;
+    unsigned int i;
+    n = SL_REF_(atomic_load(&list->head->next[0]));
+    while (n) {
+        next = SL_REF_(atomic_load(&n->next[0]));
+        SKIPLIST_NAME(_free_node)(list, n);
+        n = next;
+    }
+    for (i = 0; i < 3; ++i) {
+        n = atomic_load(&list->limbo[i]);
+        while (n) {
+            next = n->retired;
+            SKIPLIST_NAME(_free_node)(list, n);
+            n = next;
+        }
+    }
+    SKIPLIST_NAME(_free_node)(list, list->head);
+}
+
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(insert)(SL_LIST *list, SL_KEY key, SL_VAL val, SL_VAL *prior) {
+    SL_NODE *preds[SKIPLIST_MAX_LEVELS], *succs[SKIPLIST_MAX_LEVELS], *nn = NULL;
+    SKIPLIST_NAME(_stripe) *s = SKIPLIST_NAME(_stripe_of)(list);
+    unsigned int i, top, height = SKIPLIST_NAME(_random_height)(list);
+    unsigned long e = SKIPLIST_NAME(_enter)(list, s);
+    uintptr_t next;
+
+    /* `highest` only ever grows, so searches never miss a level. */
+    top = atomic_load(&list->highest);
+    while (top < height && !atomic_compare_exchange_weak(&list->highest, &top, height))
+        ;
+
+    for (;;) {
+        if (SKIPLIST_NAME(_find)(list, key, preds, succs)) {
+            if (prior)
+                *prior = SL_VALUE_(succs[0]);
+            SKIPLIST_NAME(_leave)(list, s, e);
+            if (nn)
+                SKIPLIST_NAME(_free_node)(list, nn);
+            return 1;
+        }
+        if (!nn) {
+            nn = SKIPLIST_NAME(_alloc_node)(list, height);
+            if (!nn) {
+                SKIPLIST_NAME(_leave)(list, s, e);
+                return -1;
+            }
+            nn->key = key;
+            SL_SET_VALUE_(nn, val);
+            nn->retired = NULL;
+            atomic_init(&nn->refs, 2);
+        }
+        for (i = 0; i < height; ++i)
+            atomic_store_explicit(&nn->next[i], (uintptr_t)succs[i], memory_order_relaxed);
+        next = (uintptr_t)succs[0];
+        if (atomic_compare_exchange_strong(&preds[0]->next[0], &next, (uintptr_t)nn))
+            break;
+    }
+    atomic_fetch_add(&list->size, 1);
+
+    /* The node is in the list now. Link the upper levels, giving up as soon
+       as a remover starts marking it. */
+    for (i = 1; i < height; ++i) {
+        for (;;) {
+            next = atomic_load(&nn->next[i]);
+            if (SL_MARKED_(next))
+                goto linked;
+            if (SL_REF_(next) != succs[i] &&
+                !atomic_compare_exchange_strong(&nn->next[i], &next, (uintptr_t)succs[i]))
+                continue;
+            next = (uintptr_t)succs[i];
+            if (atomic_compare_exchange_strong(&preds[i]->next[i], &next, (uintptr_t)nn))
+                break;
+            if (!SKIPLIST_NAME(_find)(list, key, preds, succs) || succs[0] != nn)
+                goto linked;
+        }
     }
+linked:
+    /* A remover that finished before the last link above could not have
+       unlinked it, so do it on the remover's behalf. */
+    if (SL_MARKED_(atomic_load(&nn->next[0])))
+        SKIPLIST_NAME(_find)(list, key, preds, succs);
+    SKIPLIST_NAME(_release)(list, nn);
+    SKIPLIST_NAME(_leave)(list, s, e);
     return 0;
 }
 
 SKIPLIST_EXTERN
-unsigned long SKIPLIST_NAME(size)(SL_LIST *list) {
-    return list->size;
+short SKIPLIST_NAME(find)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
+    SKIPLIST_NAME(_stripe) *s = SKIPLIST_NAME(_stripe_of)(list);
+    unsigned long e = SKIPLIST_NAME(_enter)(list, s);
+    SL_NODE *n = SKIPLIST_NAME(_search)(list, key);
+    short found = n && SL_COMPARE_(list, n->key, key) == 0;
+    if (found && out)
+        *out = SL_VALUE_(n);
+    SKIPLIST_NAME(_leave)(list, s, e);
+    return found;
 }
 
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(min)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
-    if (list->size == 0)
-        return 0;
-    if (key_out)
-        *key_out = list->head->next[0]->key;
-    if (val_out)
-        *val_out = list->head->next[0]->val;
-    return 1;
+SL_VAL SKIPLIST_NAME(get)(SL_LIST *list, SL_KEY key, SL_VAL default_val) {
+    SL_VAL v;
+    return SKIPLIST_NAME(find)(list, key, &v) ? v : default_val;
 }
 
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(max)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
-    int i;
-    SL_NODE *n;
-    if (list->size == 0)
-        return 0;
-    /* TODO store the biggest */
-    n = list->head;
-    for (i = 0; i < list->size; ++i)
-        n = n->next[0];
-    if (key_out)
-        *key_out = n->key;
-    if (val_out)
-        *val_out = n->val;
+short SKIPLIST_NAME(remove)(SL_LIST *list, SL_KEY key, SL_VAL *out) {
+    SL_NODE *preds[SKIPLIST_MAX_LEVELS], *succs[SKIPLIST_MAX_LEVELS];
+    SKIPLIST_NAME(_stripe) *s = SKIPLIST_NAME(_stripe_of)(list);
+    unsigned long e = SKIPLIST_NAME(_enter)(list, s);
+
+    /* Losing the race for next[0] means someone else removed this node, but
+       the key may have been inserted again since. */
+    do {
+        if (!SKIPLIST_NAME(_find)(list, key, preds, succs)) {
+            SKIPLIST_NAME(_leave)(list, s, e);
+            return 0;
+        }
+    } while (!SKIPLIST_NAME(_mark)(succs[0]));
+
+    if (out)
+        *out = SL_VALUE_(succs[0]);
+    SKIPLIST_NAME(_unlink)(list, succs[0]);
+    SKIPLIST_NAME(_leave)(list, s, e);
     return 1;
 }
 
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(pop)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
-    int i;
-    SL_NODE *first;
+int SKIPLIST_NAME(iter)(SL_LIST *list, SL_ITER_FN iter, void *userdata) {
+    SKIPLIST_NAME(_stripe) *s = SKIPLIST_NAME(_stripe_of)(list);
+    unsigned long e = SKIPLIST_NAME(_enter)(list, s);
+    SL_NODE *n = SL_REF_(SL_LOAD_(&list->head->next[0]));
+    uintptr_t next;
+    int rc = 0;
+    while (n) {
+        next = SL_LOAD_(&n->next[0]);
+        if (!SL_MARKED_(next) && (rc = iter(n->key, SL_VALUE_(n), userdata)))
+            break;
+        n = SL_REF_(next);
+    }
+    SKIPLIST_NAME(_leave)(list, s, e);
+    return rc;
+}
 
-    if (list->size == 0)
-        return 0;
+SKIPLIST_EXTERN
+unsigned long SKIPLIST_NAME(size)(SL_LIST *list) {
+    /* A remover can count a node before its inserter has, so the counter
+       may briefly dip below zero. */
+    unsigned long size = atomic_load(&list->size);
+    return size > (unsigned long)-1 / 2 ? 0 : size;
+}
 
-    first = list->head->next[0];
-    i = first->height + 1;
-    while (i --> 0) {
-        if (list->head->next[i])
-            list->head->next[i] = first->next[i];
-        else
-            --list->highest;
+SKIPLIST_EXTERN
+short SKIPLIST_NAME(min)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    SKIPLIST_NAME(_stripe) *s = SKIPLIST_NAME(_stripe_of)(list);
+    unsigned long e = SKIPLIST_NAME(_enter)(list, s);
+    SL_NODE *first = SKIPLIST_NAME(_first)(list);
+    if (first) {
+        if (key_out)
+            *key_out = first->key;
+        if (val_out)
+            *val_out = SL_VALUE_(first);
     }
-
-    if (key_out)
-        *key_out = first->key;
-    if (val_out)
-        *val_out = first->val;
-    SKIPLIST_FREE(list->mem_udata, first);
-    --list->size;
-    return 1;
+    SKIPLIST_NAME(_leave)(list, s, e);
+    return first != NULL;
 }
 
 SKIPLIST_EXTERN
-short SKIPLIST_NAME(shift)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
-    int i;
-    SL_NODE *penultimate, *last;
-    if (list->size == 0)
-        return 0;
-    penultimate = list->head;
-    for (i = 0; i < list->size - 1; ++i)
-        penultimate = penultimate->next[0];
-    last = penultimate->next[0];
+short SKIPLIST_NAME(pop)(SL_LIST *list, SL_KEY *key_out, SL_VAL *val_out) {
+    SKIPLIST_NAME(_stripe) *s = SKIPLIST_NAME(_stripe_of)(list);
+    unsigned long e = SKIPLIST_NAME(_enter)(list, s);
+    SL_NODE *first;
+    do {
+        if (!(first = SKIPLIST_NAME(_first)(list))) {
+            SKIPLIST_NAME(_leave)(list, s, e);
+            return 0;
+        }
+    } while (!SKIPLIST_NAME(_mark)(first));
+
     if (key_out)
-        *key_out = last->key;
+        *key_out = first->key;
     if (val_out)
-        *val_out = last->val;
-    i = penultimate->height;
-    while (i --> 0)
-        penultimate->next[i] = NULL;
-    SKIPLIST_FREE(list->mem_udata, last);
-    --list->size;
+        *val_out = SL_VALUE_(first);
+    SKIPLIST_NAME(_unlink)(list, first);
+    SKIPLIST_NAME(_leave)(list, s, e);
     return 1;
 }
 
+#undef SL_REF_
+#undef SL_MARKED_
+#undef SL_LOAD_
+
+#endif /* SKIPLIST_CONCURRENT */
+
 #endif
 
 #undef SL_PASTE_
 #undef SL_CAT_
+#undef SL_FLEX_
+#undef SL_ATOMIC_
+#undef SL_NEXT_
+#undef SL_SET_NEXT_
+#undef SL_PREV_
+#undef SL_SET_PREV_
+#undef SL_TAIL_
+#undef SL_SET_TAIL_
+#undef SL_LINK_
+#undef SL_TOUCH_
+#undef SL_FILE_NODE_
+#undef SL_FILE_OFF_
+#undef SL_READ_BEGIN_
+#undef SL_READ_END_
+#undef SL_EPOCHS_
+#undef SL_NODE_SIZE
+#undef SL_WIDTH_
+#undef SL_LINKS_SIZE_
+#undef SL_VAL_ALIGN_
+#undef SL_VAL_OFFSET_
+#undef SL_VALUE_
+#undef SL_SET_VALUE_
+#undef SL_VALUE_AT_
+#undef SL_SET_VALUE_AT_
+#undef SL_MOVE_VALUES_
+#undef SL_SET_
+#undef SL_COMPARE_
+#undef SL_ORDER_
+#undef SL_STAT_
+#undef SL_DUPS_
+#undef SL_KEY_BYTES_
+#undef SL_KEY_LOAD_
+#undef SL_VAL_BYTES_
+#undef SL_VAL_LOAD_
+#undef SL_STREAM_MAGIC_
+#undef SL_BLOCK_
+#undef SL_VARINT_MAX_
+#undef SL_PREFETCH_
+#undef SL_SIMD_
+#undef SL_SIMD64_
+#undef SL_VEC_
+#undef SL_VLOAD_
+#undef SL_VSTORE_
+#undef SL_VZERO_
+#undef SL_VXOR_
+#undef SL_VSET32_
+#undef SL_VGT32_
+#undef SL_VSUB32_
+#undef SL_VSET64_
+#undef SL_VGT64_
+#undef SL_VSUB64_
+#undef SL_BUILTIN_RAND_
+#undef SL_RAND64_
+#undef SL_POOL
+#undef SL_NODE_ALIGN_
+#undef SL_ALIGN_UP_
 
 #undef SL_NODE
 #undef SL_LIST
 #undef SL_CMP_FN
 #undef SL_ITER_FN
+#undef SL_WRITE_FN
+#undef SL_READ_FN
+#undef SL_CURSOR
+#undef SL_SHARDED
+#undef SL_SPLIT_FN
+#undef SL_STATS
 #undef SL_KEY
 #undef SL_VAL
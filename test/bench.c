@@ -0,0 +1,239 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+enum {
+    MAX_BENCHES = 256,
+    /* Latency samples kept per benchmark, picked uniformly from all of
+       them by reservoir sampling so that memory use stays flat. */
+    RESERVOIR = 1 << 16
+};
+
+enum { FORMAT_TABLE, FORMAT_CSV, FORMAT_JSON };
+
+typedef struct {
+    bench_fn func;
+    const char *name;
+    unsigned long n;
+} bench_t;
+
+/* What a benchmark's process reports back. */
+typedef struct {
+    unsigned long ops, samples;
+    double ns_per_op;
+    double p50, p99, p999;
+    long peak_rss_kb;
+} bench_result;
+
+static bench_t benches[MAX_BENCHES];
+static unsigned int num_benches = 0;
+
+static uint64_t started;
+static double elapsed;
+static unsigned long ops_done;
+
+static uint64_t samples[RESERVOIR];
+static unsigned long samples_seen;
+static uint64_t sample_rng = 0x2545F4914F6CDD1Du;
+
+void bench_add(bench_fn func, const char *name, unsigned long n) {
+    if (num_benches == MAX_BENCHES) {
+        fprintf(stderr, "bench: too many benchmarks, %s not added\n", name);
+        return;
+    }
+    benches[num_benches].func = func;
+    benches[num_benches].name = name;
+    benches[num_benches].n = n;
+    ++num_benches;
+}
+
+uint64_t bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void bench_start(void) {
+    samples_seen = 0;
+    started = bench_now();
+}
+
+void bench_stop(unsigned long ops) {
+    elapsed = (double)(bench_now() - started) / 1e9;
+    ops_done = ops;
+}
+
+void bench_sample(uint64_t ns) {
+    unsigned long j;
+    if (samples_seen < RESERVOIR) {
+        samples[samples_seen++] = ns;
+        return;
+    }
+    sample_rng ^= sample_rng << 13;
+    sample_rng ^= sample_rng >> 7;
+    sample_rng ^= sample_rng << 17;
+    j = (unsigned long)(sample_rng % ++samples_seen);
+    if (j < RESERVOIR)
+        samples[j] = ns;
+}
+
+static int cmp_sample(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(unsigned long count, double p) {
+    return (double)samples[(unsigned long)(p * (double)(count - 1) + 0.5)];
+}
+
+static void measure(bench_t *b, bench_result *r) {
+    struct rusage usage;
+    unsigned long count;
+    elapsed = 0;
+    ops_done = 0;
+    samples_seen = 0;
+    b->func(b->n);
+    memset(r, 0, sizeof *r);
+    r->ops = ops_done;
+    r->ns_per_op = ops_done ? elapsed * 1e9 / (double)ops_done : 0.0;
+    count = samples_seen < RESERVOIR ? samples_seen : RESERVOIR;
+    r->samples = count;
+    if (count) {
+        qsort(samples, count, sizeof *samples, cmp_sample);
+        r->p50 = percentile(count, 0.5);
+        r->p99 = percentile(count, 0.99);
+        r->p999 = percentile(count, 0.999);
+    }
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        r->peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+        r->peak_rss_kb = usage.ru_maxrss;
+#endif
+    }
+}
+
+/* Each benchmark runs in a process of its own, so that its peak RSS is its
+   own and a crash only loses that one result. */
+static int run_one(bench_t *b, bench_result *r) {
+    int fds[2], status;
+    ssize_t got;
+    pid_t pid;
+
+    fflush(stdout);
+    if (pipe(fds) != 0 || (pid = fork()) < 0) {
+        measure(b, r);
+        return 0;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        measure(b, r);
+        _exit(write(fds[1], r, sizeof *r) == (ssize_t)sizeof *r ? 0 : 1);
+    }
+    close(fds[1]);
+    got = read(fds[0], r, sizeof *r);
+    close(fds[0]);
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return 1;
+    return got != (ssize_t)sizeof *r;
+}
+
+static void print_result(int format, int first, bench_t *b, bench_result *r) {
+    switch (format) {
+    case FORMAT_CSV:
+        if (first)
+            printf("benchmark,n,ops,ns_per_op,p50_ns,p99_ns,p999_ns,peak_rss_kb\n");
+        printf("%s,%lu,%lu,%.1f,", b->name, b->n, r->ops, r->ns_per_op);
+        if (r->samples)
+            printf("%.0f,%.0f,%.0f,", r->p50, r->p99, r->p999);
+        else
+            printf(",,,");
+        printf("%ld\n", r->peak_rss_kb);
+        break;
+    case FORMAT_JSON:
+        printf("%s\n  {\"benchmark\": \"%s\", \"n\": %lu, \"ops\": %lu, \"ns_per_op\": %.1f, ",
+               first ? "[" : ",", b->name, b->n, r->ops, r->ns_per_op);
+        if (r->samples)
+            printf("\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, ", r->p50, r->p99, r->p999);
+        else
+            printf("\"p50_ns\": null, \"p99_ns\": null, \"p999_ns\": null, ");
+        printf("\"peak_rss_kb\": %ld}", r->peak_rss_kb);
+        break;
+    default:
+        if (first)
+            printf("%-40s %10s %9s %8s %8s %8s %10s\n",
+                   "benchmark", "n", "ns/op", "p50", "p99", "p99.9", "rss_kb");
+        printf("%-40s %10lu %9.1f ", b->name, b->n, r->ns_per_op);
+        if (r->samples)
+            printf("%8.0f %8.0f %8.0f ", r->p50, r->p99, r->p999);
+        else
+            printf("%8s %8s %8s ", "-", "-", "-");
+        printf("%10ld\n", r->peak_rss_kb);
+    }
+    fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-f table|csv|json] [-n max_n] [-m match]\n"
+            "  -f  output format, table by default\n"
+            "  -n  skip benchmarks over more than max_n keys, 1000000 by default\n"
+            "  -m  only run benchmarks whose name contains match\n",
+            prog);
+}
+
+int bench_run(int argc, char **argv) {
+    bench_result r;
+    const char *match = NULL;
+    unsigned long max_n = 1000000;
+    unsigned int i;
+    int opt, format = FORMAT_TABLE, first = 1, failed = 0;
+
+    while ((opt = getopt(argc, argv, "f:n:m:")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (strcmp(optarg, "table") == 0)
+                format = FORMAT_TABLE;
+            else if (strcmp(optarg, "csv") == 0)
+                format = FORMAT_CSV;
+            else if (strcmp(optarg, "json") == 0)
+                format = FORMAT_JSON;
+            else {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'n':
+            max_n = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            match = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    for (i = 0; i < num_benches; ++i) {
+        if (benches[i].n > max_n || (match && !strstr(benches[i].name, match)))
+            continue;
+        if (run_one(&benches[i], &r)) {
+            fprintf(stderr, "bench: %s with n = %lu failed\n", benches[i].name, benches[i].n);
+            failed = 1;
+            continue;
+        }
+        print_result(format, first, &benches[i], &r);
+        first = 0;
+    }
+    if (format == FORMAT_JSON)
+        printf(first ? "[]\n" : "\n]\n");
+    return failed;
+}
@@ -0,0 +1,33 @@
+#ifndef bench_h
+#define bench_h
+
+#include <stdint.h>
+
+/* A benchmark does its setup, then brackets the measured part with
+   bench_start() and bench_stop(ops), where ops is how many operations ran.
+   Every BENCH_EVERY-th operation run through BENCH_OP is also timed on its
+   own, and those times give the latency percentiles. */
+typedef void (*bench_fn)(unsigned long n);
+
+void bench_add(bench_fn func, const char *name, unsigned long n);
+void bench_start(void);
+void bench_stop(unsigned long ops);
+uint64_t bench_now(void);
+void bench_sample(uint64_t ns);
+int bench_run(int argc, char **argv);
+
+#define BENCH_EVERY 16
+
+/* Runs `op`, the i-th operation of a benchmark. */
+#define BENCH_OP(i, op) do { \
+    if ((i) % BENCH_EVERY == 0) { \
+        uint64_t bench_t_ = bench_now(); \
+        op; \
+        bench_sample(bench_now() - bench_t_); \
+    } \
+    else { \
+        op; \
+    } \
+} while (0)
+
+#endif
@@ -0,0 +1,755 @@
+#include "bench.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t bench_rand_state = 88172645463325252u;
+
+static uint64_t bench_rand(void) {
+    bench_rand_state ^= bench_rand_state << 13;
+    bench_rand_state ^= bench_rand_state >> 7;
+    bench_rand_state ^= bench_rand_state << 17;
+    return bench_rand_state;
+}
+
+/* Fixed so that runs are comparable across commits. */
+static uint64_t bench_seed = 42;
+
+static int u64_cmp(uint64_t a, uint64_t b, void *_udata) {
+    (void)_udata;
+    return (a > b) - (a < b);
+}
+
+static int int_cmp(int a, int b, void *_udata) {
+    (void)_udata;
+    return (a > b) - (a < b);
+}
+
+#define SKIPLIST_IMPLEMENTATION
+
+#define SKIPLIST_KEY uint64_t
+#define SKIPLIST_VALUE uint64_t
+#define SKIPLIST_NAMESPACE bm_
+#include "../skiplist.h"
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmp_
+#define SKIPLIST_POOL
+#include "../skiplist.h"
+#undef SKIPLIST_POOL
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmc_
+#define SKIPLIST_CMP(a, b, udata) (((a) > (b)) - ((a) < (b)))
+#include "../skiplist.h"
+#undef SKIPLIST_CMP
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmt_
+#define SKIPLIST_CONCURRENT
+#include "../skiplist.h"
+#undef SKIPLIST_CONCURRENT
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmf_
+#define SKIPLIST_FAT_NODES 16
+#include "../skiplist.h"
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmfi_
+#define SKIPLIST_INT_KEYS
+#include "../skiplist.h"
+#undef SKIPLIST_INT_KEYS
+#undef SKIPLIST_FAT_NODES
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bms_
+#define SKIPLIST_SHARDED
+#include "../skiplist.h"
+#undef SKIPLIST_SHARDED
+
+#undef SKIPLIST_KEY
+#undef SKIPLIST_VALUE
+#define SKIPLIST_KEY int
+#define SKIPLIST_VALUE int
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmi_
+#include "../skiplist.h"
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmic_
+#define SKIPLIST_CMP(a, b, udata) (((a) > (b)) - ((a) < (b)))
+#include "../skiplist.h"
+#undef SKIPLIST_CMP
+
+/* Values of one and four cache lines, stored next to the key or after
+   the links. */
+typedef struct { uint64_t w[8]; } val64;
+typedef struct { uint64_t w[32]; } val256;
+
+#undef SKIPLIST_KEY
+#undef SKIPLIST_VALUE
+#define SKIPLIST_KEY uint64_t
+#define SKIPLIST_VALUE val64
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmv64_
+#include "../skiplist.h"
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmv64c_
+#define SKIPLIST_COLD_VALUES
+#include "../skiplist.h"
+#undef SKIPLIST_COLD_VALUES
+
+#undef SKIPLIST_VALUE
+#define SKIPLIST_VALUE val256
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmv256_
+#include "../skiplist.h"
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE bmv256c_
+#define SKIPLIST_COLD_VALUES
+#include "../skiplist.h"
+#undef SKIPLIST_COLD_VALUES
+
+/* Keep n keys live while replacing a random one with a fresh key each step,
+   so every step is one remove and one insert of a new node. */
+#define CHURN_BENCH(ns) \
+static void bench_churn_ ## ns(unsigned long n) { \
+    ns ## skiplist sl; \
+    unsigned long i, j; \
+    uint64_t *live = malloc(n * sizeof *live); \
+    ns ## init(&sl, u64_cmp, NULL, NULL, NULL); \
+    ns ## seed(&sl, bench_seed); \
+    for (i = 0; i < n; ++i) { \
+        live[i] = bench_rand(); \
+        ns ## insert(&sl, live[i], i, NULL); \
+    } \
+    bench_start(); \
+    for (i = 0; i < 4 * n; ++i) { \
+        j = bench_rand() % n; \
+        ns ## remove(&sl, live[j], NULL); \
+        live[j] = bench_rand(); \
+        ns ## insert(&sl, live[j], i, NULL); \
+    } \
+    bench_stop(4 * n); \
+    ns ## free(&sl); \
+    free(live); \
+}
+
+CHURN_BENCH(bm_)
+CHURN_BENCH(bmp_)
+CHURN_BENCH(bmf_)
+
+/* Look up every key once, in random order. */
+#define FIND_BENCH(ns, type, cmp) \
+static void bench_find_ ## ns(unsigned long n) { \
+    ns ## skiplist sl; \
+    unsigned long i, j, hits = 0; \
+    type t, *keys = malloc(n * sizeof *keys); \
+    ns ## init(&sl, cmp, NULL, NULL, NULL); \
+    ns ## seed(&sl, bench_seed); \
+    for (i = 0; i < n; ++i) { \
+        keys[i] = (type)(i * 2); \
+        ns ## insert(&sl, keys[i], keys[i], NULL); \
+    } \
+    for (i = n; i-- > 1; ) { \
+        j = bench_rand() % (i + 1); \
+        t = keys[i]; keys[i] = keys[j]; keys[j] = t; \
+    } \
+    bench_start(); \
+    for (i = 0; i < n; ++i) \
+        hits += ns ## find(&sl, keys[i], NULL); \
+    bench_stop(n); \
+    if (hits != n) \
+        abort(); \
+    ns ## free(&sl); \
+    free(keys); \
+}
+
+FIND_BENCH(bm_, uint64_t, u64_cmp)
+FIND_BENCH(bmf_, uint64_t, u64_cmp)
+FIND_BENCH(bmfi_, uint64_t, NULL)
+FIND_BENCH(bmc_, uint64_t, NULL)
+FIND_BENCH(bmi_, int, int_cmp)
+FIND_BENCH(bmic_, int, NULL)
+
+/* Look up every key once, in random order, without reading the value. */
+#define VALUE_BENCH(ns, type) \
+static void bench_value_ ## ns(unsigned long n) { \
+    ns ## skiplist sl; \
+    unsigned long i, j, hits = 0; \
+    uint64_t t, *keys = malloc(n * sizeof *keys); \
+    type v = { { 0 } }; \
+    ns ## init(&sl, u64_cmp, NULL, NULL, NULL); \
+    ns ## seed(&sl, bench_seed); \
+    for (i = 0; i < n; ++i) { \
+        keys[i] = i * 2; \
+        v.w[0] = i; \
+        ns ## insert(&sl, keys[i], v, NULL); \
+    } \
+    for (i = n; i-- > 1; ) { \
+        j = bench_rand() % (i + 1); \
+        t = keys[i]; keys[i] = keys[j]; keys[j] = t; \
+    } \
+    bench_start(); \
+    for (i = 0; i < n; ++i) \
+        hits += ns ## find(&sl, keys[i], NULL); \
+    bench_stop(n); \
+    if (hits != n) \
+        abort(); \
+    ns ## free(&sl); \
+    free(keys); \
+}
+
+VALUE_BENCH(bmv64_, val64)
+VALUE_BENCH(bmv64c_, val64)
+VALUE_BENCH(bmv256_, val256)
+VALUE_BENCH(bmv256c_, val256)
+
+/* Visit every pair in order. */
+static int iter_sum(uint64_t key, uint64_t val, void *udata) {
+    (void)key;
+    *(uint64_t *)udata += val;
+    return 0;
+}
+
+#define ITER_BENCH(ns) \
+static void bench_iter_ ## ns(unsigned long n) { \
+    ns ## skiplist sl; \
+    unsigned long i; \
+    uint64_t sum = 0; \
+    ns ## init(&sl, u64_cmp, NULL, NULL, NULL); \
+    ns ## seed(&sl, bench_seed); \
+    for (i = 0; i < n; ++i) \
+        ns ## insert(&sl, bench_rand(), i, NULL); \
+    bench_start(); \
+    for (i = 0; i < 10; ++i) \
+        ns ## iter(&sl, iter_sum, &sum); \
+    bench_stop(10 * n); \
+    if (sum == 0) \
+        abort(); \
+    ns ## free(&sl); \
+}
+
+ITER_BENCH(bm_)
+ITER_BENCH(bmf_)
+
+/* Workloads over a list of the n keys 0, 2, ... 2n - 2. Keys are picked
+   in order (seq), uniformly at random (uniform), or from a Zipf
+   distribution with YCSB's exponent of 0.99 (zipf), whose popular keys are
+   scattered over the list rather than bunched at the front. Lookups and
+   mixes run WORK_OPS operations whatever n is. */
+#define WORK_OPS 1000000
+#define ZIPF_THETA 0.99
+/* A prime, so multiplying by it modulo n permutes [0, n) for every n
+   registered below. */
+#define SCRAMBLE 2654435761u
+
+enum { DIST_SEQ, DIST_UNIFORM, DIST_ZIPF };
+
+/* Gray et al.'s generator, as in YCSB. zeta(n) takes a pass over n, so it
+   is only computed once per n. */
+static struct {
+    unsigned long n;
+    double zetan, alpha, eta, half;
+} zipf;
+
+static void zipf_init(unsigned long n) {
+    unsigned long i;
+    if (zipf.n == n)
+        return;
+    zipf.n = n;
+    zipf.zetan = 0;
+    for (i = 1; i <= n; ++i)
+        zipf.zetan += pow((double)i, -ZIPF_THETA);
+    zipf.half = pow(0.5, ZIPF_THETA);
+    zipf.alpha = 1 / (1 - ZIPF_THETA);
+    zipf.eta = (1 - pow(2.0 / (double)n, 1 - ZIPF_THETA)) / (1 - (1 + zipf.half) / zipf.zetan);
+}
+
+static unsigned long zipf_next(void) {
+    double u = (double)(bench_rand() >> 11) / 9007199254740992.0, uz = u * zipf.zetan;
+    unsigned long r;
+    if (uz < 1)
+        return 0;
+    if (uz < 1 + zipf.half)
+        return 1;
+    r = (unsigned long)((double)zipf.n * pow(zipf.eta * u - zipf.eta + 1, zipf.alpha));
+    return r < zipf.n ? r : zipf.n - 1;
+}
+
+/* The index of the i-th key to visit. */
+static unsigned long work_pick(int dist, unsigned long i, unsigned long n) {
+    switch (dist) {
+    case DIST_SEQ:
+        return i % n;
+    case DIST_UNIFORM:
+        return bench_rand() % n;
+    default:
+        return (uint64_t)zipf_next() * SCRAMBLE % n;
+    }
+}
+
+/* Appends the n keys in chunks, so that setting up 100M keys needs no
+   100M-entry arrays. */
+static void work_fill(bm_skiplist *sl, unsigned long n) {
+    uint64_t keys[4096];
+    unsigned long i, j;
+    for (i = 0; i < n; i += j) {
+        for (j = 0; j < 4096 && i + j < n; ++j)
+            keys[j] = (i + j) * 2;
+        bm_build_sorted(sl, keys, keys, j);
+    }
+}
+
+enum { WORK_INSERT, WORK_FIND_HIT, WORK_FIND_MISS, WORK_REMOVE, WORK_ITER, WORK_POP, WORK_SHIFT };
+
+static void bench_work(unsigned long n, int op, int dist) {
+    bm_skiplist sl;
+    unsigned long i, k, hits = 0, ops = n;
+    uint64_t sum = 0;
+    if (dist == DIST_ZIPF)
+        zipf_init(n);
+    bm_init(&sl, u64_cmp, NULL, NULL, NULL);
+    bm_seed(&sl, bench_seed);
+    if (op != WORK_INSERT)
+        work_fill(&sl, n);
+    bench_start();
+    switch (op) {
+    case WORK_INSERT:
+        /* Every key once, except that zipf repeats popular keys and so
+           mostly overwrites. */
+        for (i = 0; i < n; ++i) {
+            k = dist == DIST_UNIFORM ? (uint64_t)i * SCRAMBLE % n : work_pick(dist, i, n);
+            BENCH_OP(i, bm_insert(&sl, k * 2, i, NULL));
+        }
+        break;
+    case WORK_FIND_HIT:
+    case WORK_FIND_MISS:
+        ops = WORK_OPS;
+        for (i = 0; i < ops; ++i) {
+            k = work_pick(dist, i, n) * 2 + (op == WORK_FIND_MISS);
+            BENCH_OP(i, hits += bm_find(&sl, k, NULL));
+        }
+        if (hits != (op == WORK_FIND_HIT ? ops : 0))
+            abort();
+        break;
+    case WORK_REMOVE:
+        for (i = 0; i < n; ++i) {
+            k = dist == DIST_UNIFORM ? (uint64_t)i * SCRAMBLE % n : i;
+            BENCH_OP(i, hits += bm_remove(&sl, k * 2, NULL));
+        }
+        if (hits != n)
+            abort();
+        break;
+    case WORK_ITER:
+        bm_iter(&sl, iter_sum, &sum);
+        break;
+    case WORK_POP:
+        for (i = 0; i < n; ++i)
+            BENCH_OP(i, hits += bm_pop(&sl, NULL, NULL));
+        break;
+    default:
+        for (i = 0; i < n; ++i)
+            BENCH_OP(i, hits += bm_shift(&sl, NULL, NULL));
+    }
+    bench_stop(ops);
+    if ((op == WORK_POP || op == WORK_SHIFT) && hits != n)
+        abort();
+    bm_free(&sl);
+}
+
+/* Finds of present keys mixed with writes that insert an absent odd key
+   next to the picked one, or remove it again, so the size stays near n. */
+static void bench_mixed(unsigned long n, unsigned int read_pct, int dist) {
+    bm_skiplist sl;
+    unsigned long i, k, hits = 0;
+    if (dist == DIST_ZIPF)
+        zipf_init(n);
+    bm_init(&sl, u64_cmp, NULL, NULL, NULL);
+    bm_seed(&sl, bench_seed);
+    work_fill(&sl, n);
+    bench_start();
+    for (i = 0; i < WORK_OPS; ++i) {
+        k = work_pick(dist, i, n) * 2;
+        if (bench_rand() % 100 < read_pct)
+            BENCH_OP(i, hits += bm_find(&sl, k, NULL));
+        else
+            BENCH_OP(i, (void)(bm_remove(&sl, k + 1, NULL) || bm_insert(&sl, k + 1, k, NULL)));
+    }
+    bench_stop(WORK_OPS);
+    if (hits == 0)
+        abort();
+    bm_free(&sl);
+}
+
+#define WORK_BENCH(name, op, dist) \
+static void bench_work_ ## name(unsigned long n) { bench_work(n, op, dist); }
+WORK_BENCH(insert_seq, WORK_INSERT, DIST_SEQ)
+WORK_BENCH(insert_uniform, WORK_INSERT, DIST_UNIFORM)
+WORK_BENCH(insert_zipf, WORK_INSERT, DIST_ZIPF)
+WORK_BENCH(find_hit_seq, WORK_FIND_HIT, DIST_SEQ)
+WORK_BENCH(find_hit_uniform, WORK_FIND_HIT, DIST_UNIFORM)
+WORK_BENCH(find_hit_zipf, WORK_FIND_HIT, DIST_ZIPF)
+WORK_BENCH(find_miss_uniform, WORK_FIND_MISS, DIST_UNIFORM)
+WORK_BENCH(remove_seq, WORK_REMOVE, DIST_SEQ)
+WORK_BENCH(remove_uniform, WORK_REMOVE, DIST_UNIFORM)
+WORK_BENCH(iter, WORK_ITER, DIST_SEQ)
+WORK_BENCH(pop, WORK_POP, DIST_SEQ)
+WORK_BENCH(shift, WORK_SHIFT, DIST_SEQ)
+
+#define MIXED_BENCH(name, read_pct, dist) \
+static void bench_mixed_ ## name(unsigned long n) { bench_mixed(n, read_pct, dist); }
+MIXED_BENCH(90_uniform, 90, DIST_UNIFORM)
+MIXED_BENCH(90_zipf, 90, DIST_ZIPF)
+MIXED_BENCH(50_uniform, 50, DIST_UNIFORM)
+MIXED_BENCH(50_zipf, 50, DIST_ZIPF)
+
+/* Load n sorted keys, one insert at a time or all at once. */
+#define LOAD_BENCH(ns) \
+static void bench_load_insert_ ## ns(unsigned long n) { \
+    ns ## skiplist sl; \
+    unsigned long i; \
+    ns ## init(&sl, u64_cmp, NULL, NULL, NULL); \
+    ns ## seed(&sl, bench_seed); \
+    bench_start(); \
+    for (i = 0; i < n; ++i) \
+        ns ## insert(&sl, i, i, NULL); \
+    bench_stop(n); \
+    ns ## free(&sl); \
+} \
+static void bench_load_build_ ## ns(unsigned long n) { \
+    ns ## skiplist sl; \
+    unsigned long i; \
+    uint64_t *keys = malloc(n * sizeof *keys); \
+    for (i = 0; i < n; ++i) \
+        keys[i] = i; \
+    ns ## init(&sl, u64_cmp, NULL, NULL, NULL); \
+    ns ## seed(&sl, bench_seed); \
+    bench_start(); \
+    ns ## build_sorted(&sl, keys, keys, n); \
+    bench_stop(n); \
+    ns ## free(&sl); \
+    free(keys); \
+}
+
+LOAD_BENCH(bm_)
+LOAD_BENCH(bmp_)
+
+/* Save n pairs to memory and restore them with deserialize, which is the
+   same linear pass as build_sorted plus decoding. */
+struct snapshot {
+    unsigned char *data;
+    size_t len, pos;
+};
+
+static size_t snapshot_write(const void *p, size_t len, void *udata) {
+    struct snapshot *s = udata;
+    memcpy(s->data + s->len, p, len);
+    s->len += len;
+    return len;
+}
+
+static size_t snapshot_read(void *p, size_t len, void *udata) {
+    struct snapshot *s = udata;
+    if (len > s->len - s->pos)
+        len = s->len - s->pos;
+    memcpy(p, s->data + s->pos, len);
+    s->pos += len;
+    return len;
+}
+
+static void bench_snapshot(unsigned long n, int restore) {
+    bm_skiplist sl, copy;
+    struct snapshot s;
+    unsigned long i;
+    /* Each pair takes two one-byte lengths and 16 bytes, and each block
+       of up to 4096 bytes a length of its own. */
+    s.data = malloc(n * 19 + 64);
+    s.len = s.pos = 0;
+    bm_init(&sl, u64_cmp, NULL, NULL, NULL);
+    bm_seed(&sl, bench_seed);
+    for (i = 0; i < n; ++i)
+        bm_insert(&sl, i, i, NULL);
+    bm_init(&copy, u64_cmp, NULL, NULL, NULL);
+    bm_seed(&copy, bench_seed);
+    bench_start();
+    bm_serialize(&sl, snapshot_write, &s);
+    if (restore) {
+        bench_start();
+        bm_deserialize(&copy, snapshot_read, &s);
+    }
+    bench_stop(n);
+    bm_free(&copy);
+    bm_free(&sl);
+    free(s.data);
+}
+
+static void bench_snapshot_save(unsigned long n) { bench_snapshot(n, 0); }
+static void bench_snapshot_restore(unsigned long n) { bench_snapshot(n, 1); }
+
+/* Look up batches of 256 keys: in one sorted run of nearby keys, or drawn
+   at random, with one find per key or one find_many per batch. */
+#define BATCH 256
+static void bench_batch(unsigned long n, int clustered, int many) {
+    bm_skiplist sl;
+    uint64_t keys[BATCH], vals[BATCH], start;
+    unsigned long i, j, hits = 0;
+    bm_init(&sl, u64_cmp, NULL, NULL, NULL);
+    bm_seed(&sl, bench_seed);
+    for (i = 0; i < n; ++i)
+        bm_insert(&sl, i * 2, i, NULL);
+    bench_start();
+    for (i = 0; i < n; i += BATCH) {
+        start = bench_rand() % n * 2;
+        for (j = 0; j < BATCH; ++j)
+            keys[j] = clustered ? (start + j * 4) % (2 * n) : bench_rand() % (2 * n);
+        if (many)
+            hits += bm_find_many(&sl, keys, BATCH, vals, NULL, !clustered);
+        else {
+            for (j = 0; j < BATCH; ++j)
+                hits += bm_find(&sl, keys[j], &vals[j]);
+        }
+    }
+    bench_stop((n + BATCH - 1) / BATCH * BATCH);
+    if (hits == 0)
+        abort();
+    bm_free(&sl);
+}
+
+static void bench_batch_sorted_find(unsigned long n) { bench_batch(n, 1, 0); }
+static void bench_batch_sorted_many(unsigned long n) { bench_batch(n, 1, 1); }
+static void bench_batch_random_find(unsigned long n) { bench_batch(n, 0, 0); }
+static void bench_batch_random_many(unsigned long n) { bench_batch(n, 0, 1); }
+
+/* Ingest sorted runs of 256 new keys into a list of n keys. */
+static void bench_ingest(unsigned long n, int batched) {
+    bm_skiplist sl;
+    uint64_t keys[BATCH], start;
+    unsigned long i, j;
+    bm_init(&sl, u64_cmp, NULL, NULL, NULL);
+    bm_seed(&sl, bench_seed);
+    for (i = 0; i < n; ++i)
+        bm_insert(&sl, i * 1024, i, NULL);
+    bench_start();
+    for (i = 0; i < n; i += BATCH) {
+        start = bench_rand() % n * 1024 + bench_rand() % 1024;
+        for (j = 0; j < BATCH; ++j)
+            keys[j] = start + j;
+        if (batched)
+            bm_insert_sorted_batch(&sl, keys, keys, BATCH, NULL, NULL);
+        else {
+            for (j = 0; j < BATCH; ++j)
+                bm_insert(&sl, keys[j], keys[j], NULL);
+        }
+    }
+    bench_stop((n + BATCH - 1) / BATCH * BATCH);
+    bm_free(&sl);
+}
+
+static void bench_ingest_insert(unsigned long n) { bench_ingest(n, 0); }
+static void bench_ingest_batch(unsigned long n) { bench_ingest(n, 1); }
+
+/* Threads share a list of n keys drawn from [0, 2n) and run a mix of 80%
+   find, 10% insert and 10% remove, either on the lock-free list, on a
+   plain list behind one mutex or on THREAD_SHARDS lists behind a mutex
+   each. ns/op is wall time over all threads' ops, so it falls as
+   throughput scales. */
+#define THREAD_OPS 1000000
+#define THREAD_SHARDS 16
+
+enum { THREADS_LOCKFREE, THREADS_MUTEX, THREADS_SHARDED };
+
+static bm_skiplist threads_locked;
+static bmt_skiplist threads_free;
+static bms_sharded threads_sharded;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int u64_split(uint64_t key, unsigned int count, void *_udata) {
+    (void)_udata;
+    return (unsigned int)((key * 0x9e3779b97f4a7c15u) >> 32) % count;
+}
+
+struct thread_arg {
+    pthread_t thread;
+    unsigned long n, ops;
+    uint64_t rng;
+    int mode;
+};
+
+static void *bench_thread(void *p) {
+    struct thread_arg *a = p;
+    unsigned long i;
+    uint64_t key, r;
+    for (i = 0; i < a->ops; ++i) {
+        a->rng ^= a->rng << 13;
+        a->rng ^= a->rng >> 7;
+        a->rng ^= a->rng << 17;
+        r = a->rng % 10;
+        key = (a->rng >> 8) % (2 * a->n);
+        if (a->mode == THREADS_MUTEX) {
+            pthread_mutex_lock(&threads_lock);
+            if (r == 0)
+                bm_insert(&threads_locked, key, key, NULL);
+            else if (r == 1)
+                bm_remove(&threads_locked, key, NULL);
+            else
+                bm_find(&threads_locked, key, NULL);
+            pthread_mutex_unlock(&threads_lock);
+        } else if (a->mode == THREADS_SHARDED) {
+            if (r == 0)
+                bms_sharded_insert(&threads_sharded, key, key, NULL);
+            else if (r == 1)
+                bms_sharded_remove(&threads_sharded, key, NULL);
+            else
+                bms_sharded_find(&threads_sharded, key, NULL);
+        } else {
+            if (r == 0)
+                bmt_insert(&threads_free, key, key, NULL);
+            else if (r == 1)
+                bmt_remove(&threads_free, key, NULL);
+            else
+                bmt_find(&threads_free, key, NULL);
+        }
+    }
+    return NULL;
+}
+
+static void bench_threads(unsigned long n, unsigned int threads, int mode) {
+    struct thread_arg args[32];
+    unsigned int t;
+    if (mode == THREADS_MUTEX) {
+        bm_init(&threads_locked, u64_cmp, NULL, NULL, NULL);
+        bm_seed(&threads_locked, bench_seed);
+        while (bm_size(&threads_locked) < n)
+            bm_insert(&threads_locked, bench_rand() % (2 * n), 0, NULL);
+    } else if (mode == THREADS_SHARDED) {
+        bms_sharded_init(&threads_sharded, THREAD_SHARDS, u64_split, NULL, u64_cmp, NULL, NULL, NULL);
+        while (bms_sharded_size(&threads_sharded) < n)
+            bms_sharded_insert(&threads_sharded, bench_rand() % (2 * n), 0, NULL);
+    } else {
+        bmt_init(&threads_free, u64_cmp, NULL, NULL, NULL);
+        while (bmt_size(&threads_free) < n)
+            bmt_insert(&threads_free, bench_rand() % (2 * n), 0, NULL);
+    }
+    bench_start();
+    for (t = 0; t < threads; ++t) {
+        args[t].n = n;
+        args[t].ops = THREAD_OPS / threads;
+        args[t].rng = bench_rand() | 1;
+        args[t].mode = mode;
+        pthread_create(&args[t].thread, NULL, bench_thread, &args[t]);
+    }
+    for (t = 0; t < threads; ++t)
+        pthread_join(args[t].thread, NULL);
+    bench_stop(THREAD_OPS / threads * threads);
+    if (mode == THREADS_MUTEX)
+        bm_free(&threads_locked);
+    else if (mode == THREADS_SHARDED)
+        bms_sharded_free(&threads_sharded);
+    else
+        bmt_free(&threads_free);
+}
+
+#define THREADS_BENCH(t) \
+static void bench_threads_lockfree_ ## t(unsigned long n) { bench_threads(n, t, THREADS_LOCKFREE); } \
+static void bench_threads_mutex_ ## t(unsigned long n) { bench_threads(n, t, THREADS_MUTEX); } \
+static void bench_threads_sharded_ ## t(unsigned long n) { bench_threads(n, t, THREADS_SHARDED); }
+
+THREADS_BENCH(1)
+THREADS_BENCH(2)
+THREADS_BENCH(4)
+THREADS_BENCH(8)
+THREADS_BENCH(16)
+THREADS_BENCH(32)
+
+int main(int argc, char **argv) {
+    unsigned long n;
+    /* The larger sizes only run when -n allows them. */
+    for (n = 1000; n <= 100000000; n *= n < 10000000 ? 100 : 10) {
+        bench_add(bench_work_insert_seq, "work/insert/seq", n);
+        bench_add(bench_work_insert_uniform, "work/insert/uniform", n);
+        bench_add(bench_work_insert_zipf, "work/insert/zipf", n);
+        bench_add(bench_work_find_hit_seq, "work/find_hit/seq", n);
+        bench_add(bench_work_find_hit_uniform, "work/find_hit/uniform", n);
+        bench_add(bench_work_find_hit_zipf, "work/find_hit/zipf", n);
+        bench_add(bench_work_find_miss_uniform, "work/find_miss/uniform", n);
+        bench_add(bench_work_remove_seq, "work/remove/seq", n);
+        bench_add(bench_work_remove_uniform, "work/remove/uniform", n);
+        bench_add(bench_work_iter, "work/iter", n);
+        bench_add(bench_work_pop, "work/pop", n);
+        bench_add(bench_work_shift, "work/shift", n);
+        bench_add(bench_mixed_90_uniform, "work/mixed_90r/uniform", n);
+        bench_add(bench_mixed_90_zipf, "work/mixed_90r/zipf", n);
+        bench_add(bench_mixed_50_uniform, "work/mixed_50r/uniform", n);
+        bench_add(bench_mixed_50_zipf, "work/mixed_50r/zipf", n);
+    }
+    for (n = 1000; n <= 1000000; n *= 100) {
+        bench_add(bench_churn_bm_, "churn/malloc", n);
+        bench_add(bench_churn_bmp_, "churn/pool", n);
+        bench_add(bench_churn_bmf_, "churn/fat", n);
+    }
+    for (n = 1000; n <= 1000000; n *= 100) {
+        bench_add(bench_find_bmi_, "find/int/cmp_fn", n);
+        bench_add(bench_find_bmic_, "find/int/SKIPLIST_CMP", n);
+        bench_add(bench_find_bm_, "find/uint64/cmp_fn", n);
+        bench_add(bench_find_bmc_, "find/uint64/SKIPLIST_CMP", n);
+        bench_add(bench_find_bmf_, "find/uint64/fat", n);
+        bench_add(bench_find_bmfi_, "find/uint64/fat/SKIPLIST_INT_KEYS", n);
+    }
+    for (n = 1000; n <= 1000000; n *= 100) {
+        bench_add(bench_value_bmv64_, "find/value64", n);
+        bench_add(bench_value_bmv64c_, "find/value64/SKIPLIST_COLD_VALUES", n);
+        bench_add(bench_value_bmv256_, "find/value256", n);
+        bench_add(bench_value_bmv256c_, "find/value256/SKIPLIST_COLD_VALUES", n);
+    }
+    for (n = 1000; n <= 1000000; n *= 100) {
+        bench_add(bench_iter_bm_, "iter", n);
+        bench_add(bench_iter_bmf_, "iter/fat", n);
+    }
+    for (n = 1000; n <= 1000000; n *= 100) {
+        bench_add(bench_load_insert_bm_, "load/insert", n);
+        bench_add(bench_load_build_bm_, "load/build_sorted", n);
+        bench_add(bench_load_insert_bmp_, "load/insert/pool", n);
+        bench_add(bench_load_build_bmp_, "load/build_sorted/pool", n);
+        bench_add(bench_snapshot_save, "load/serialize", n);
+        bench_add(bench_snapshot_restore, "load/deserialize", n);
+    }
+    for (n = 1000; n <= 1000000; n *= 100) {
+        bench_add(bench_batch_sorted_find, "batch/clustered/find", n);
+        bench_add(bench_batch_sorted_many, "batch/clustered/find_many", n);
+        bench_add(bench_batch_random_find, "batch/random/find", n);
+        bench_add(bench_batch_random_many, "batch/random/find_many", n);
+    }
+    for (n = 1000; n <= 1000000; n *= 100) {
+        bench_add(bench_ingest_insert, "ingest/insert", n);
+        bench_add(bench_ingest_batch, "ingest/insert_sorted_batch", n);
+    }
+    bench_add(bench_threads_mutex_1, "threads/mutex/1", 100000);
+    bench_add(bench_threads_lockfree_1, "threads/lockfree/1", 100000);
+    bench_add(bench_threads_sharded_1, "threads/sharded/1", 100000);
+    bench_add(bench_threads_mutex_2, "threads/mutex/2", 100000);
+    bench_add(bench_threads_lockfree_2, "threads/lockfree/2", 100000);
+    bench_add(bench_threads_sharded_2, "threads/sharded/2", 100000);
+    bench_add(bench_threads_mutex_4, "threads/mutex/4", 100000);
+    bench_add(bench_threads_lockfree_4, "threads/lockfree/4", 100000);
+    bench_add(bench_threads_sharded_4, "threads/sharded/4", 100000);
+    bench_add(bench_threads_mutex_8, "threads/mutex/8", 100000);
+    bench_add(bench_threads_lockfree_8, "threads/lockfree/8", 100000);
+    bench_add(bench_threads_sharded_8, "threads/sharded/8", 100000);
+    bench_add(bench_threads_mutex_16, "threads/mutex/16", 100000);
+    bench_add(bench_threads_lockfree_16, "threads/lockfree/16", 100000);
+    bench_add(bench_threads_sharded_16, "threads/sharded/16", 100000);
+    bench_add(bench_threads_mutex_32, "threads/mutex/32", 100000);
+    bench_add(bench_threads_lockfree_32, "threads/lockfree/32", 100000);
+    bench_add(bench_threads_sharded_32, "threads/sharded/32", 100000);
+    return bench_run(argc, argv);
+}
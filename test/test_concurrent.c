@@ -0,0 +1,439 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ptest.h"
+
+#define SKIPLIST_KEY int
+#define SKIPLIST_VALUE int
+#define SKIPLIST_NAMESPACE slt_
+#define SKIPLIST_CONCURRENT
+#define SKIPLIST_IMPLEMENTATION
+#include "../skiplist.h"
+#undef SKIPLIST_CONCURRENT
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slw_
+#define SKIPLIST_SWMR
+#define SKIPLIST_POOL
+#define SKIPLIST_POOL_SLAB 8
+#include "../skiplist.h"
+#undef SKIPLIST_SWMR
+#undef SKIPLIST_POOL
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slh_
+#define SKIPLIST_SHARDED
+#include "../skiplist.h"
+#undef SKIPLIST_SHARDED
+
+#define THREADS 8
+
+static int cmp(int a, int b, void *udata) {
+    (void)udata;
+    return a < b ? -1 : a > b;
+}
+
+struct worker {
+    slt_skiplist *list;
+    pthread_t thread;
+    int id;
+    unsigned int rng;
+    int errors;
+    long count;
+    /* Keys id, id + THREADS, id + 2 * THREADS, ... belong to this worker. */
+    char *has;
+    int *popped;
+};
+
+static unsigned int next_rand(struct worker *w) {
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 17;
+    w->rng ^= w->rng << 5;
+    return w->rng;
+}
+
+static void *own_keys(void *arg) {
+    struct worker *w = arg;
+    int i, slot, key, val;
+    for (i = 0; i < 20000; ++i) {
+        slot = next_rand(w) % 512;
+        key = slot * THREADS + w->id;
+        switch (next_rand(w) % 3) {
+        case 0:
+            if (slt_insert(w->list, key, -key, NULL) != w->has[slot])
+                ++w->errors;
+            w->has[slot] = 1;
+            break;
+        case 1:
+            if (slt_remove(w->list, key, &val) != w->has[slot] || (w->has[slot] && val != -key))
+                ++w->errors;
+            w->has[slot] = 0;
+            break;
+        default:
+            if (slt_find(w->list, key, &val) != w->has[slot] || (w->has[slot] && val != -key))
+                ++w->errors;
+        }
+    }
+    return NULL;
+}
+
+static void *shared_keys(void *arg) {
+    struct worker *w = arg;
+    int i, key, val;
+    for (i = 0; i < 20000; ++i) {
+        key = next_rand(w) % 64;
+        switch (next_rand(w) % 3) {
+        case 0:
+            if (slt_insert(w->list, key, key * 2, &val) == 1 && val != key * 2)
+                ++w->errors;
+            break;
+        case 1:
+            if (slt_remove(w->list, key, &val) && val != key * 2)
+                ++w->errors;
+            break;
+        default:
+            if (slt_find(w->list, key, &val) && val != key * 2)
+                ++w->errors;
+        }
+    }
+    return NULL;
+}
+
+static void *pop_all(void *arg) {
+    struct worker *w = arg;
+    int key, val, last = -1;
+    while (slt_pop(w->list, &key, &val)) {
+        if (val != -key || key <= last)
+            ++w->errors;
+        last = key;
+        w->popped[w->count++] = key;
+    }
+    return NULL;
+}
+
+struct check {
+    int last;
+    unsigned long count;
+    int sorted;
+};
+
+static int check_order(int key, int val, void *udata) {
+    struct check *c = udata;
+    (void)val;
+    if (c->count && key <= c->last)
+        c->sorted = 0;
+    c->last = key;
+    ++c->count;
+    return 0;
+}
+
+static int run(slt_skiplist *list, struct worker *w, void *(*fn)(void *)) {
+    int t, errors = 0;
+    for (t = 0; t < THREADS; ++t) {
+        w[t].list = list;
+        w[t].id = t;
+        w[t].rng = 2463534242u + t * 7919;
+        w[t].errors = 0;
+        w[t].count = 0;
+        pthread_create(&w[t].thread, NULL, fn, &w[t]);
+    }
+    for (t = 0; t < THREADS; ++t) {
+        pthread_join(w[t].thread, NULL);
+        errors += w[t].errors;
+    }
+    return errors;
+}
+
+static void test_concurrent_own(void) {
+    slt_skiplist list;
+    struct worker w[THREADS];
+    struct check c = { 0, 0, 1 };
+    unsigned long expected = 0;
+    int t, i;
+    PT_ASSERT(slt_init(&list, cmp, NULL, NULL, NULL) == 0);
+    for (t = 0; t < THREADS; ++t)
+        w[t].has = calloc(512, 1);
+    PT_ASSERT(run(&list, w, own_keys) == 0);
+
+    for (t = 0; t < THREADS; ++t) {
+        for (i = 0; i < 512; ++i) {
+            expected += w[t].has[i];
+            PT_ASSERT(slt_find(&list, i * THREADS + t, NULL) == w[t].has[i]);
+        }
+        free(w[t].has);
+    }
+    slt_iter(&list, check_order, &c);
+    PT_ASSERT(c.sorted);
+    PT_ASSERT(c.count == expected);
+    PT_ASSERT(slt_size(&list) == expected);
+    slt_free(&list);
+}
+
+static void test_concurrent_shared(void) {
+    slt_skiplist list;
+    struct worker w[THREADS];
+    struct check c = { 0, 0, 1 };
+    int key;
+    PT_ASSERT(slt_init(&list, cmp, NULL, NULL, NULL) == 0);
+    PT_ASSERT(run(&list, w, shared_keys) == 0);
+
+    slt_iter(&list, check_order, &c);
+    PT_ASSERT(c.sorted);
+    PT_ASSERT(slt_size(&list) == c.count);
+    for (key = 0; key < 64; ++key)
+        slt_remove(&list, key, NULL);
+    PT_ASSERT(slt_size(&list) == 0);
+    PT_ASSERT(slt_min(&list, NULL, NULL) == 0);
+    PT_ASSERT(slt_get(&list, 1, 7) == 7);
+    slt_free(&list);
+}
+
+static void test_concurrent_pop(void) {
+    slt_skiplist list;
+    struct worker w[THREADS];
+    char *seen = calloc(10000, 1);
+    long total = 0;
+    int t, i, ok = 1;
+    PT_ASSERT(slt_init(&list, cmp, NULL, NULL, NULL) == 0);
+    for (i = 0; i < 10000; ++i)
+        slt_insert(&list, i, -i, NULL);
+    for (t = 0; t < THREADS; ++t)
+        w[t].popped = malloc(10000 * sizeof(int));
+    PT_ASSERT(run(&list, w, pop_all) == 0);
+
+    for (t = 0; t < THREADS; ++t) {
+        for (i = 0; i < w[t].count; ++i) {
+            if (seen[w[t].popped[i]]++)
+                ok = 0;
+        }
+        total += w[t].count;
+        free(w[t].popped);
+    }
+    PT_ASSERT(ok);
+    PT_ASSERT(total == 10000);
+    PT_ASSERT(slt_size(&list) == 0);
+    free(seen);
+    slt_free(&list);
+}
+
+/* Values are key + 1024 * version, so readers can tell a torn or stale
+   node from a good one. Keys below 128 are overwritten but never removed. */
+struct swmr {
+    slw_skiplist list;
+    atomic_int done;
+    int errors[THREADS];
+    long reads[THREADS];
+};
+
+struct reader {
+    struct swmr *sh;
+    pthread_t thread;
+    int id;
+};
+
+static int check_swmr(int key, int val, void *udata) {
+    struct check *c = udata;
+    if (val % 1024 != key || (c->count && key <= c->last))
+        c->sorted = 0;
+    c->last = key;
+    ++c->count;
+    return 0;
+}
+
+static void *swmr_reader(void *arg) {
+    struct reader *r = arg;
+    struct swmr *sh = r->sh;
+    unsigned int rng = 12345 + r->id;
+    int key, val = 0, last;
+    unsigned long token;
+    slw_cursor cur;
+    while (!atomic_load(&sh->done)) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        key = rng % 1024;
+        if (slw_find(&sh->list, key, &val)) {
+            if (val % 1024 != key)
+                ++sh->errors[r->id];
+        }
+        else if (key < 128)
+            ++sh->errors[r->id];
+        if (rng % 64 == 0) {
+            struct check c = { 0, 0, 1 };
+            slw_iter(&sh->list, check_swmr, &c);
+            if (!c.sorted || c.count < 128)
+                ++sh->errors[r->id];
+        }
+        if (rng % 64 == 1) {
+            last = -1;
+            token = slw_read_lock(&sh->list);
+            if (slw_cursor_seek(&sh->list, &cur, key)) {
+                do {
+                    slw_cursor_get(&cur, &key, &val);
+                    if (key <= last || val % 1024 != key)
+                        ++sh->errors[r->id];
+                    last = key;
+                } while (slw_cursor_next(&cur) && key < last + 64);
+            }
+            slw_read_unlock(&sh->list, token);
+        }
+        if (rng % 64 == 2) {
+            if (!slw_max(&sh->list, &key, &val) || val % 1024 != key)
+                ++sh->errors[r->id];
+            last = 1024;
+            token = slw_read_lock(&sh->list);
+            if (slw_cursor_last(&sh->list, &cur)) {
+                do {
+                    slw_cursor_get(&cur, &key, &val);
+                    if (key >= last || val % 1024 != key)
+                        ++sh->errors[r->id];
+                    last = key;
+                } while (slw_cursor_prev(&cur) && key > last - 64);
+            }
+            slw_read_unlock(&sh->list, token);
+        }
+        ++sh->reads[r->id];
+    }
+    return NULL;
+}
+
+static void test_swmr(void) {
+    static struct swmr sh;
+    struct reader r[THREADS - 1];
+    struct check c = { 0, 0, 1 };
+    unsigned int rng = 2463534242u;
+    int t, i, key, errors = 0;
+    PT_ASSERT(slw_init(&sh.list, cmp, NULL, NULL, NULL) == 0);
+    atomic_init(&sh.done, 0);
+    for (key = 0; key < 128; ++key)
+        slw_insert(&sh.list, key, key, NULL);
+    for (t = 0; t < THREADS - 1; ++t) {
+        r[t].sh = &sh;
+        r[t].id = t;
+        sh.errors[t] = 0;
+        pthread_create(&r[t].thread, NULL, swmr_reader, &r[t]);
+    }
+
+    for (i = 1; i < 100000; ++i) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        key = rng % 1024;
+        if (key >= 128 && rng % 3 == 0)
+            slw_remove(&sh.list, key, NULL);
+        else
+            slw_insert(&sh.list, key, key + 1024 * (i % 1000), NULL);
+        if (i % 20000 == 0)
+            slw_synchronize(&sh.list);
+    }
+    atomic_store(&sh.done, 1);
+    for (t = 0; t < THREADS - 1; ++t) {
+        pthread_join(r[t].thread, NULL);
+        errors += sh.errors[t];
+    }
+    PT_ASSERT(errors == 0);
+
+    slw_synchronize(&sh.list);
+    PT_ASSERT(sh.list.limbo[0] == NULL && sh.list.limbo[1] == NULL && sh.list.limbo[2] == NULL);
+    slw_iter(&sh.list, check_swmr, &c);
+    PT_ASSERT(c.sorted);
+    PT_ASSERT(c.count == slw_size(&sh.list));
+    slw_free(&sh.list);
+}
+
+/* find_many resumes each search from the path of the previous key, and
+   under SKIPLIST_SWMR the writer may add levels to the list in between. */
+static void test_swmr_finger(void) {
+    slw_skiplist list;
+    slw__finger f;
+    slw_node *p;
+    unsigned int height;
+    int key;
+    PT_ASSERT(slw_init(&list, cmp, NULL, NULL, NULL) == 0);
+    for (key = 0; key < 8; key += 2)
+        slw_insert(&list, key, key, NULL);
+    memset(&f, 0, sizeof f);
+    p = slw__finger_seek(&list, &f, 3, 0);
+    PT_ASSERT(p->key == 2);
+    height = list.highest;
+    for (key = 8; key < 8192; key += 2)
+        slw_insert(&list, key, key, NULL);
+    PT_ASSERT(list.highest > height);
+    p = slw__finger_seek(&list, &f, 4001, 0);
+    PT_ASSERT(p->key == 4000);
+    p = slw__finger_seek(&list, &f, 6001, 0);
+    PT_ASSERT(p->key == 6000);
+    slw_free(&list);
+}
+
+static unsigned int split_hash(int key, unsigned int count, void *udata) {
+    (void)udata;
+    return (unsigned int)key * 2654435761u % count;
+}
+
+struct sharder {
+    slh_sharded *s;
+    pthread_t thread;
+    int id;
+    int errors;
+};
+
+/* Each thread adds its own keys, then removes every other one. */
+static void *sharded_keys(void *arg) {
+    struct sharder *w = arg;
+    int i, key, val;
+    for (i = 0; i < 2000; ++i) {
+        if (slh_sharded_insert(w->s, i * THREADS + w->id, -(i * THREADS + w->id), NULL) != 0)
+            ++w->errors;
+    }
+    for (i = 0; i < 2000; i += 2) {
+        key = i * THREADS + w->id;
+        if (slh_sharded_remove(w->s, key, &val) != 1 || val != -key)
+            ++w->errors;
+    }
+    for (i = 0; i < 2000; ++i) {
+        key = i * THREADS + w->id;
+        if (slh_sharded_find(w->s, key, &val) != i % 2 || (i % 2 && val != -key))
+            ++w->errors;
+    }
+    return NULL;
+}
+
+static void test_sharded(void) {
+    slh_sharded s;
+    struct sharder w[THREADS];
+    struct check c = { 0, 0, 1 };
+    unsigned int i;
+    int t, errors = 0;
+    PT_ASSERT(slh_sharded_init(&s, 5, split_hash, NULL, cmp, NULL, NULL, NULL) == 0);
+    for (t = 0; t < THREADS; ++t) {
+        w[t].s = &s;
+        w[t].id = t;
+        w[t].errors = 0;
+        pthread_create(&w[t].thread, NULL, sharded_keys, &w[t]);
+    }
+    for (t = 0; t < THREADS; ++t) {
+        pthread_join(w[t].thread, NULL);
+        errors += w[t].errors;
+    }
+    PT_ASSERT(errors == 0);
+
+    for (i = 0; i < s.count; ++i)
+        PT_ASSERT(slh_size(&s.shards[i].list) > 0);
+    slh_sharded_iter(&s, check_order, &c);
+    PT_ASSERT(c.sorted);
+    PT_ASSERT(c.count == THREADS * 1000);
+    PT_ASSERT(slh_sharded_size(&s) == THREADS * 1000);
+    PT_ASSERT(slh_sharded_get(&s, THREADS, 7) == -THREADS);
+    PT_ASSERT(slh_sharded_get(&s, 0, 7) == 7);
+    slh_sharded_free(&s);
+}
+
+void suite_concurrent(void) {
+    pt_add_test(test_concurrent_own, "Should keep each thread's keys intact under contention", "concurrent");
+    pt_add_test(test_concurrent_shared, "Should stay consistent when threads share keys", "concurrent");
+    pt_add_test(test_concurrent_pop, "Should hand each key to exactly one popping thread", "concurrent");
+    pt_add_test(test_swmr, "Should let readers run alongside a single writer", "concurrent");
+    pt_add_test(test_swmr_finger, "Should not climb a search finger past the levels it was built on", "concurrent");
+    pt_add_test(test_sharded, "Should keep shards apart and merge them in order", "concurrent");
+}
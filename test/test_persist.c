@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ptest.h"
+
+#define SKIPLIST_KEY int
+#define SKIPLIST_VALUE int
+#define SKIPLIST_NAMESPACE slm_
+#define SKIPLIST_PERSIST
+#define SKIPLIST_INDEXED
+#define SKIPLIST_IMPLEMENTATION
+#include "../skiplist.h"
+#undef SKIPLIST_INDEXED
+
+/* Same types, different node layout */
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE sln_
+#include "../skiplist.h"
+
+/* With long values these two have nodes of the same size, but the second
+   keeps the value after the links. */
+#undef SKIPLIST_VALUE
+#define SKIPLIST_VALUE long
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slq_
+#include "../skiplist.h"
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slo_
+#define SKIPLIST_COLD_VALUES
+#include "../skiplist.h"
+#undef SKIPLIST_COLD_VALUES
+#undef SKIPLIST_PERSIST
+
+static int cmp(int a, int b, void *udata) {
+    (void)udata;
+    return a < b ? -1 : a > b;
+}
+
+/* Keys 3i for i in [0, 2000) not divisible by 4, then 10000 + i for i in
+   [0, 100), each with value -key. */
+static int expected(int key) {
+    if (key >= 10000)
+        return key < 10100;
+    return key >= 0 && key < 6000 && key % 3 == 0 && (key / 3) % 4 != 0;
+}
+
+static int check_list(slm_skiplist *list) {
+    slm_cursor cur;
+    unsigned long i = 0, r;
+    int key, val, last = 1 << 30, ok = 1;
+    for (key = -1; key < 10200; ++key)
+        ok &= slm_find(list, key, &val) == expected(key) && (!expected(key) || val == -key);
+    ok &= slm_size(list) == 1500 + 100;
+    ok &= slm_at(list, 1499, &key, NULL) && key == 5997;
+    ok &= slm_rank(list, 10000, &r) && r == 1500;
+    /* Walk backwards to check the prev links and the tail. */
+    if (slm_cursor_last(list, &cur)) {
+        do {
+            slm_cursor_get(&cur, &key, &val);
+            ok &= key < last && val == -key;
+            last = key;
+            ++i;
+        } while (slm_cursor_prev(&cur));
+    }
+    return ok && i == slm_size(list);
+}
+
+static void test_persist_reopen(void) {
+    slm_skiplist list;
+    sln_skiplist other;
+    uint64_t seed = 7;
+    char path[] = "/tmp/skiplist_XXXXXX";
+    int fd = mkstemp(path), i, keys[100], vals[100], status;
+    pid_t pid;
+    PT_ASSERT(fd >= 0);
+    close(fd);
+
+    PT_ASSERT(slm_open(&list, path, 1, 0, cmp, NULL, NULL, NULL) == 2);
+    PT_ASSERT(slm_open(&list, path, 0, 1 << 24, cmp, NULL, NULL, NULL) == 0);
+    slm_seed(&list, seed);
+    for (i = 0; i < 2000; ++i)
+        slm_insert(&list, (i * 7 % 2000) * 3, 0, NULL);
+    for (i = 0; i < 2000; ++i) {
+        if (i % 4 == 0)
+            slm_remove(&list, i * 3, NULL);
+        else
+            slm_insert(&list, i * 3, -i * 3, NULL);
+    }
+    for (i = 0; i < 100; ++i) {
+        keys[i] = 10000 + i;
+        vals[i] = -keys[i];
+    }
+    PT_ASSERT(slm_build_sorted(&list, keys, vals, 100) == 0);
+    PT_ASSERT(check_list(&list));
+    PT_ASSERT(slm_close(&list) == 0);
+
+    /* Another process may read it while this one does. */
+    PT_ASSERT(slm_open(&list, path, 1, 0, cmp, NULL, NULL, NULL) == 0);
+    pid = fork();
+    if (pid == 0) {
+        slm_skiplist child;
+        if (slm_open(&child, path, 0, 1 << 24, cmp, NULL, NULL, NULL) != 1)
+            _exit(1);
+        if (slm_open(&child, path, 1, 0, cmp, NULL, NULL, NULL) != 0)
+            _exit(1);
+        _exit(check_list(&child) ? 0 : 1);
+    }
+    PT_ASSERT(pid > 0 && waitpid(pid, &status, 0) == pid);
+    PT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    PT_ASSERT(check_list(&list));
+    PT_ASSERT(sln_open(&other, path, 1, 0, cmp, NULL, NULL, NULL) == 2);
+    slm_free(&list);
+
+    /* Removed nodes are reused, and the generator carries on. */
+    PT_ASSERT(slm_open(&list, path, 0, 1 << 24, cmp, NULL, NULL, NULL) == 0);
+    PT_ASSERT(check_list(&list));
+    for (i = 0; i < 100; ++i)
+        PT_ASSERT(slm_pop(&list, NULL, NULL));
+    for (i = 0; i < 100; ++i)
+        PT_ASSERT(slm_insert(&list, -1 - i, 0, NULL) == 0);
+    PT_ASSERT(slm_size(&list) == 1600);
+    PT_ASSERT(slm_sync(&list) == 0);
+    slm_free(&list);
+    PT_ASSERT(slm_open(&list, path, 0, 1 << 24, cmp, NULL, NULL, NULL) == 0);
+    PT_ASSERT(slm_size(&list) == 1600);
+    PT_ASSERT(slm_min(&list, &i, NULL) && i == -100);
+    PT_ASSERT(slm_max(&list, &i, NULL) && i == 10099);
+
+    /* A change after the last sync spoils the file. */
+    slm_remove(&list, -1, NULL);
+    slm_free(&list);
+    PT_ASSERT(slm_open(&list, path, 1, 0, cmp, NULL, NULL, NULL) == 2);
+    unlink(path);
+}
+
+static void test_persist_layout(void) {
+    slq_skiplist list;
+    slo_skiplist cold;
+    char path[] = "/tmp/skiplist_XXXXXX";
+    int fd = mkstemp(path), i;
+    PT_ASSERT(fd >= 0);
+    close(fd);
+
+    PT_ASSERT(slq_open(&list, path, 0, 1 << 20, cmp, NULL, NULL, NULL) == 0);
+    for (i = 0; i < 10; ++i)
+        slq_insert(&list, i, i * 100L, NULL);
+    PT_ASSERT(slq_close(&list) == 0);
+    PT_ASSERT(slo_open(&cold, path, 1, 0, cmp, NULL, NULL, NULL) == 2);
+    PT_ASSERT(slq_open(&list, path, 1, 0, cmp, NULL, NULL, NULL) == 0);
+    PT_ASSERT(slq_get(&list, 9, -1) == 900);
+    slq_free(&list);
+    unlink(path);
+}
+
+static void test_persist_full(void) {
+    slm_skiplist list;
+    char path[] = "/tmp/skiplist_XXXXXX";
+    int fd = mkstemp(path), i, rc = 0;
+    PT_ASSERT(fd >= 0);
+    close(fd);
+
+    PT_ASSERT(slm_open(&list, path, 0, 4096, cmp, NULL, NULL, NULL) == 0);
+    for (i = 0; i < 1000 && (rc = slm_insert(&list, i, i, NULL)) == 0; ++i)
+        ;
+    PT_ASSERT(rc == -1);
+    PT_ASSERT(slm_size(&list) == (unsigned long)i);
+    /* Overwriting a value needs no new node. */
+    PT_ASSERT(slm_insert(&list, 1, 42, NULL) == 1);
+    PT_ASSERT(slm_remove(&list, 0, NULL) == 1);
+    PT_ASSERT(slm_close(&list) == 0);
+
+    PT_ASSERT(slm_open(&list, path, 1, 0, cmp, NULL, NULL, NULL) == 0);
+    PT_ASSERT(slm_size(&list) == (unsigned long)i - 1);
+    PT_ASSERT(slm_get(&list, 1, -1) == 42);
+    PT_ASSERT(slm_get(&list, i - 1, -1) == i - 1);
+    PT_ASSERT(slm_get(&list, 0, -1) == -1);
+    slm_free(&list);
+    unlink(path);
+}
+
+static void test_persist_memory(void) {
+    slm_skiplist list;
+    int i, key;
+    PT_ASSERT(slm_init(&list, cmp, NULL, NULL, NULL) == 0);
+    PT_ASSERT(slm_sync(&list) == 0);
+    for (i = 0; i < 500; ++i)
+        slm_insert(&list, i * 37 % 500, i, NULL);
+    for (i = 0; i < 500; i += 2)
+        slm_remove(&list, i, NULL);
+    PT_ASSERT(slm_size(&list) == 250);
+    PT_ASSERT(slm_shift(&list, &key, NULL) && key == 499);
+    PT_ASSERT(slm_pop(&list, &key, NULL) && key == 1);
+    PT_ASSERT(slm_at(&list, 0, &key, NULL) && key == 3);
+    slm_free(&list);
+}
+
+void suite_persist(void) {
+    pt_add_test(test_persist_reopen, "Should reopen a list from its file", "persist");
+    pt_add_test(test_persist_layout, "Should refuse a file with another node layout", "persist");
+    pt_add_test(test_persist_full, "Should fail inserts once the file is full", "persist");
+    pt_add_test(test_persist_memory, "Should still work in memory", "persist");
+}
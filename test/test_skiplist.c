@@ -116,6 +116,362 @@ TEST(iter_stop)
     }
 END(iter_stop)
 
+TEST(iter_range)
+    struct iter_data id;
+    int i;
+    id.cnt = 0;
+    PT_ASSERT(sl_iter_range(&sl, 0, 100, int_iter, &id) == 0);
+    PT_ASSERT(id.cnt == 0);
+    for (i = 0; i < 50; ++i)
+        sl_insert(&sl, i * 2, i, NULL);
+
+    PT_ASSERT(sl_iter_range(&sl, 7, 16, int_iter, &id) == 0);
+    PT_ASSERT(id.cnt == 4);
+    for (i = 0; i < 4; ++i) {
+        PT_ASSERT(id.keys[i] == 8 + i * 2);
+        PT_ASSERT(id.vals[i] == 4 + i);
+    }
+
+    id.cnt = 0;
+    PT_ASSERT(sl_iter_range(&sl, 10, 10, int_iter, &id) == 0);
+    PT_ASSERT(sl_iter_range(&sl, 200, 300, int_iter, &id) == 0);
+    PT_ASSERT(id.cnt == 0);
+    PT_ASSERT(sl_iter_range(&sl, 94, 1000, int_iter, &id) == 0);
+    PT_ASSERT(id.cnt == 3);
+    PT_ASSERT(id.keys[2] == 98);
+    id.cnt = 0;
+    PT_ASSERT(sl_iter_range(&sl, -5, 10, int_iter_stop, &id) == 0);
+    PT_ASSERT(id.cnt == 5);
+END(iter_range)
+
+TEST(bounds)
+    int k, v;
+    PT_ASSERT(sl_lower_bound(&sl, 0, &k, &v) == 0);
+    PT_ASSERT(sl_upper_bound(&sl, 0, &k, &v) == 0);
+    sl_insert(&sl, 10, 1, NULL);
+    sl_insert(&sl, 20, 2, NULL);
+    sl_insert(&sl, 30, 3, NULL);
+    PT_ASSERT(sl_lower_bound(&sl, 20, &k, &v) == 1);
+    PT_ASSERT(k == 20 && v == 2);
+    PT_ASSERT(sl_upper_bound(&sl, 20, &k, &v) == 1);
+    PT_ASSERT(k == 30 && v == 3);
+    PT_ASSERT(sl_lower_bound(&sl, 11, &k, NULL) == 1);
+    PT_ASSERT(k == 20);
+    PT_ASSERT(sl_upper_bound(&sl, -1, &k, NULL) == 1);
+    PT_ASSERT(k == 10);
+    PT_ASSERT(sl_lower_bound(&sl, 31, &k, NULL) == 0);
+    PT_ASSERT(sl_upper_bound(&sl, 30, &k, NULL) == 0);
+END(bounds)
+
+TEST(cursor)
+    sl_cursor c;
+    sl_skiplist other;
+    int i, k = 0, v = 0, last, merged;
+    PT_ASSERT(sl_cursor_first(&sl, &c) == 0);
+    PT_ASSERT(sl_cursor_last(&sl, &c) == 0);
+    PT_ASSERT(sl_cursor_get(&c, &k, &v) == 0);
+    PT_ASSERT(sl_cursor_next(&c) == 0);
+
+    for (i = 0; i < 100; ++i)
+        sl_insert(&sl, (i * 17) % 100 * 2, i, NULL);
+    PT_ASSERT(sl_cursor_first(&sl, &c) == 1);
+    for (i = 0; i < 100; ++i) {
+        PT_ASSERT(sl_cursor_get(&c, &k, NULL) == 1);
+        PT_ASSERT(k == i * 2);
+        PT_ASSERT(sl_cursor_next(&c) == (i < 99));
+    }
+    PT_ASSERT(sl_cursor_get(&c, &k, NULL) == 0);
+    PT_ASSERT(sl_cursor_last(&sl, &c) == 1);
+    for (i = 99; i >= 0; --i) {
+        PT_ASSERT(sl_cursor_get(&c, &k, NULL) == 1);
+        PT_ASSERT(k == i * 2);
+        PT_ASSERT(sl_cursor_prev(&c) == (i > 0));
+    }
+    PT_ASSERT(sl_cursor_seek(&sl, &c, 51) == 1);
+    PT_ASSERT(sl_cursor_get(&c, &k, &v) == 1);
+    PT_ASSERT(k == 52);
+    PT_ASSERT(sl_cursor_prev(&c) == 1);
+    PT_ASSERT(sl_cursor_get(&c, &k, NULL) == 1);
+    PT_ASSERT(k == 50);
+    PT_ASSERT(sl_cursor_seek(&sl, &c, 199) == 0);
+
+    /* Two-way merge of even and odd keys */
+    sl_init(&other, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 100; ++i)
+        sl_insert(&other, i * 2 + 1, i, NULL);
+    {
+        sl_cursor a, b;
+        int ka = 0, kb = 0, has_a = sl_cursor_first(&sl, &a), has_b = sl_cursor_first(&other, &b);
+        last = -1;
+        merged = 0;
+        while (has_a || has_b) {
+            sl_cursor_get(&a, &ka, NULL);
+            sl_cursor_get(&b, &kb, NULL);
+            if (has_a && (!has_b || ka < kb)) {
+                k = ka;
+                has_a = sl_cursor_next(&a);
+            }
+            else {
+                k = kb;
+                has_b = sl_cursor_next(&b);
+            }
+            PT_ASSERT(k == last + 1);
+            last = k;
+            ++merged;
+        }
+        PT_ASSERT(merged == 200);
+    }
+    sl_free(&other);
+END(cursor)
+
+TEST(build_sorted)
+    int keys[300], vals[300], i, k, v;
+    for (i = 0; i < 300; ++i) {
+        keys[i] = i * 3;
+        vals[i] = -i;
+    }
+    PT_ASSERT(sl_build_sorted(&sl, keys, vals, 0) == 0);
+    PT_ASSERT(sl_build_sorted(&sl, keys, vals, 200) == 0);
+    PT_ASSERT(sl_size(&sl) == 200);
+    PT_ASSERT(sl_build_sorted(&sl, keys + 150, vals + 150, 100) == 1);
+    keys[250] = 0;
+    PT_ASSERT(sl_build_sorted(&sl, keys + 200, vals + 200, 100) == 1);
+    PT_ASSERT(sl_size(&sl) == 200);
+    keys[250] = 750;
+    PT_ASSERT(sl_build_sorted(&sl, keys + 200, vals + 200, 100) == 0);
+    PT_ASSERT(sl_size(&sl) == 300);
+    for (i = 0; i < 300; ++i) {
+        PT_ASSERT(sl_find(&sl, i * 3, &v) == 1);
+        PT_ASSERT(v == -i);
+        PT_ASSERT(sl_find(&sl, i * 3 + 1, NULL) == 0);
+    }
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 897);
+    PT_ASSERT(sl_insert(&sl, 1, 1, NULL) == 0);
+    PT_ASSERT(sl_shift(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 897);
+    for (i = 0; i < 100; ++i)
+        PT_ASSERT(sl_remove(&sl, i * 3, NULL) == 1);
+    PT_ASSERT(sl_pop(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 1);
+    PT_ASSERT(sl_pop(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 300);
+END(build_sorted)
+
+TEST(find_many)
+    int keys[400], out[400], i;
+    short found[400];
+    PT_ASSERT(sl_find_many(&sl, NULL, 0, out, found, 0) == 0);
+    for (i = 0; i < 400; ++i)
+        keys[i] = i;
+    PT_ASSERT(sl_find_many(&sl, keys, 400, out, found, 0) == 0);
+    PT_ASSERT(found[0] == 0 && found[399] == 0);
+    for (i = 0; i < 300; ++i)
+        sl_insert(&sl, i * 2, i, NULL);
+
+    PT_ASSERT(sl_find_many(&sl, keys, 400, out, found, 0) == 200);
+    for (i = 0; i < 400; ++i) {
+        PT_ASSERT(found[i] == !(i & 1));
+        if (found[i])
+            PT_ASSERT(out[i] == i / 2);
+    }
+
+    for (i = 0; i < 400; ++i) {
+        keys[i] = (i * 149) % 400 + 300;
+        out[i] = -1;
+    }
+    keys[17] = keys[18];
+    PT_ASSERT(sl_find_many(&sl, keys, 400, out, found, 1) == 151);
+    for (i = 0; i < 400; ++i) {
+        PT_ASSERT(found[i] == (keys[i] < 600 && !(keys[i] & 1)));
+        PT_ASSERT(out[i] == (found[i] ? keys[i] / 2 : -1));
+    }
+    PT_ASSERT(sl_find_many(&sl, keys, 400, NULL, NULL, 0) == 151);
+END(find_many)
+
+int count_replaced(int k, int v, void *data) {
+    (void)k;
+    *(int *)data += v;
+    return 0;
+}
+
+TEST(insert_sorted_batch)
+    int keys[200], vals[200], i, k, v, replaced = 0;
+    for (i = 0; i < 100; ++i)
+        sl_insert(&sl, i * 4, 1, NULL);
+    for (i = 0; i < 200; ++i) {
+        keys[i] = i * 2;
+        vals[i] = i;
+    }
+    PT_ASSERT(sl_insert_sorted_batch(&sl, keys, vals, 200, count_replaced, &replaced) == 100);
+    PT_ASSERT(replaced == 100);
+    PT_ASSERT(sl_size(&sl) == 200);
+    for (i = 0; i < 200; ++i) {
+        PT_ASSERT(sl_find(&sl, i * 2, &v) == 1);
+        PT_ASSERT(v == i);
+    }
+
+    /* Unsorted, with a repeated key */
+    for (i = 0; i < 200; ++i) {
+        keys[i] = (i * 83) % 200 * 2 + 1;
+        vals[i] = -i;
+    }
+    keys[11] = keys[10];
+    PT_ASSERT(sl_insert_sorted_batch(&sl, keys, vals, 200, NULL, NULL) == 199);
+    PT_ASSERT(sl_find(&sl, keys[10], &v) == 1);
+    PT_ASSERT(v == -11);
+    PT_ASSERT(sl_size(&sl) == 399);
+    for (i = 0, k = -1; sl_pop(&sl, &v, NULL); ++i, k = v)
+        PT_ASSERT(v > k);
+    PT_ASSERT(i == 399);
+END(insert_sorted_batch)
+
+TEST(merge)
+    sl_skiplist other;
+    int i, k, v;
+    sl_init(&other, int_cmp, NULL, NULL, NULL);
+    sl_merge(&sl, &other);
+    PT_ASSERT(sl_size(&sl) == 0);
+    for (i = 0; i < 100; ++i) {
+        sl_insert(&sl, i * 3, 0, NULL);
+        sl_insert(&other, i * 2, 1, NULL);
+    }
+    sl_merge(&sl, &other);
+    PT_ASSERT(sl_size(&other) == 0);
+    PT_ASSERT(sl_find(&other, 0, NULL) == 0);
+    PT_ASSERT(sl_size(&sl) == 166);
+    for (i = 0; i < 300; ++i) {
+        PT_ASSERT(sl_find(&sl, i, &v) == ((i % 3 == 0) || (i % 2 == 0 && i < 200)));
+        if (i % 2 == 0 && i < 200)
+            PT_ASSERT(v == 1);
+    }
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1 && k == 297);
+    PT_ASSERT(sl_shift(&sl, &k, NULL) == 1 && k == 297);
+    sl_insert(&other, 1000, 1, NULL);
+    sl_merge(&sl, &other);
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1 && k == 1000);
+    sl_free(&other);
+END(merge)
+
+TEST(erase_range)
+    int i, k;
+    PT_ASSERT(sl_erase_range(&sl, 0, 10) == 0);
+    for (i = 0; i < 200; ++i)
+        sl_insert(&sl, i * 2, i, NULL);
+    PT_ASSERT(sl_erase_range(&sl, 50, 50) == 0);
+    PT_ASSERT(sl_erase_range(&sl, 51, 52) == 0);
+    PT_ASSERT(sl_erase_range(&sl, 51, 101) == 25);
+    PT_ASSERT(sl_size(&sl) == 175);
+    for (i = 0; i < 400; ++i)
+        PT_ASSERT(sl_find(&sl, i, NULL) == (i % 2 == 0 && (i < 51 || i >= 101)));
+    PT_ASSERT(sl_upper_bound(&sl, 50, &k, NULL) == 1 && k == 102);
+    PT_ASSERT(sl_erase_range(&sl, 300, 1000) == 50);
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1 && k == 298);
+    PT_ASSERT(sl_erase_range(&sl, -5, 20) == 10);
+    PT_ASSERT(sl_min(&sl, &k, NULL) == 1 && k == 20);
+    PT_ASSERT(sl_erase_range(&sl, 0, 1000) == 115);
+    PT_ASSERT(sl_size(&sl) == 0 && sl.highest == 0);
+    PT_ASSERT(sl_max(&sl, NULL, NULL) == 0);
+    sl_insert(&sl, 7, 7, NULL);
+    PT_ASSERT(sl_min(&sl, &k, NULL) == 1 && k == 7);
+END(erase_range)
+
+TEST(split)
+    sl_skiplist other;
+    int i, k, v;
+    sl_init(&other, int_cmp, NULL, NULL, NULL);
+    PT_ASSERT(sl_split(&sl, 5, &other) == 0);
+    for (i = 0; i < 100; ++i)
+        sl_insert(&sl, i, i, NULL);
+    PT_ASSERT(sl_split(&sl, 100, &other) == 0);
+    PT_ASSERT(sl_split(&sl, 30, &other) == 70);
+    PT_ASSERT(sl_size(&sl) == 30 && sl_size(&other) == 70);
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1 && k == 29);
+    PT_ASSERT(sl_min(&other, &k, NULL) == 1 && k == 30);
+    PT_ASSERT(sl_max(&other, &k, NULL) == 1 && k == 99);
+    for (i = 0; i < 100; ++i) {
+        PT_ASSERT(sl_find(i < 30 ? &sl : &other, i, &v) == 1 && v == i);
+        PT_ASSERT(sl_find(i < 30 ? &other : &sl, i, NULL) == 0);
+    }
+    /* Walking back from the new first node stops at the head. */
+    PT_ASSERT(sl_pop(&other, &k, NULL) == 1 && k == 30);
+    for (i = 0; sl_shift(&other, &k, NULL); ++i)
+        PT_ASSERT(k == 99 - i);
+    PT_ASSERT(i == 69);
+    PT_ASSERT(sl_split(&sl, -1, &other) == 30);
+    PT_ASSERT(sl_size(&sl) == 0 && sl.highest == 0);
+    sl_insert(&sl, 1, 1, NULL);
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1 && k == 1);
+    sl_free(&other);
+END(split)
+
+struct order_data {
+    int cnt, last, stop;
+};
+
+int check_order(int k, int v, void *data) {
+    struct order_data *od = (struct order_data *)data;
+    (void)v;
+    if (od->cnt > 0 && k <= od->last)
+        od->stop = -1;
+    od->last = k;
+    return ++od->cnt == od->stop;
+}
+
+TEST(set_algebra)
+    sl_skiplist other, dst;
+    struct order_data od = {0, 0, 0};
+    int i, k, v;
+    sl_init(&other, int_cmp, NULL, NULL, NULL);
+    sl_init(&dst, int_cmp, NULL, NULL, NULL);
+    PT_ASSERT(sl_intersect(&sl, &other, &dst, NULL, NULL) == 0);
+    PT_ASSERT(sl_union(&sl, &other, &dst, NULL, NULL) == 0);
+    for (i = 0; i < 1000; ++i)
+        sl_insert(&sl, i * 2, i, NULL);
+    for (i = 0; i < 100; ++i)
+        sl_insert(&other, i * 3, -i, NULL);
+    sl_insert(&other, 5000, 0, NULL);
+
+    PT_ASSERT(sl_intersect(&sl, &other, NULL, NULL, NULL) == 50);
+    PT_ASSERT(sl_intersect(&other, &sl, NULL, NULL, NULL) == 50);
+    PT_ASSERT(sl_intersect(&sl, &sl, NULL, NULL, NULL) == 1000);
+    sl_insert(&dst, 12, 100, NULL);
+    sl_insert(&dst, 13, 100, NULL);
+    PT_ASSERT(sl_intersect(&sl, &other, &dst, NULL, NULL) == 50);
+    PT_ASSERT(sl_size(&dst) == 51);
+    for (i = 0; i < 300; ++i)
+        PT_ASSERT(sl_find(&dst, i, &v) == (i % 6 == 0 || i == 13) && (i % 6 || v == i / 2));
+    PT_ASSERT(sl_max(&dst, &k, NULL) == 1 && k == 294);
+
+    PT_ASSERT(sl_union(&sl, &other, NULL, check_order, &od) == 1051);
+    PT_ASSERT(od.cnt == 1051 && od.stop == 0 && od.last == 5000);
+    sl_free(&dst);
+    sl_init(&dst, int_cmp, NULL, NULL, NULL);
+    PT_ASSERT(sl_union(&other, &sl, &dst, NULL, NULL) == 1051);
+    PT_ASSERT(sl_find(&dst, 6, &v) == 1 && v == -2);
+    PT_ASSERT(sl_find(&dst, 8, &v) == 1 && v == 4);
+    PT_ASSERT(sl_find(&dst, 9, &v) == 1 && v == -3);
+
+    PT_ASSERT(sl_difference(&sl, &other, NULL, NULL, NULL) == 950);
+    PT_ASSERT(sl_difference(&sl, &sl, NULL, NULL, NULL) == 0);
+    sl_free(&dst);
+    sl_init(&dst, int_cmp, NULL, NULL, NULL);
+    PT_ASSERT(sl_difference(&other, &sl, &dst, NULL, NULL) == 51);
+    for (i = 0; i < 300; ++i)
+        PT_ASSERT(sl_find(&dst, i, NULL) == (i % 3 == 0 && i % 2 != 0));
+    PT_ASSERT(sl_max(&dst, &k, NULL) == 1 && k == 5000);
+
+    od.cnt = 0;
+    od.stop = 3;
+    PT_ASSERT(sl_intersect(&sl, &other, NULL, check_order, &od) == 3);
+    PT_ASSERT(od.cnt == 3 && od.last == 12);
+    od.cnt = 0;
+    PT_ASSERT(sl_difference(&sl, &other, NULL, check_order, &od) == 3);
+    PT_ASSERT(od.cnt == 3 && od.last == 8);
+    sl_free(&other);
+    sl_free(&dst);
+END(set_algebra)
+
 TEST(remove)
     int rm;
     int val;
@@ -205,6 +561,857 @@ TEST(shift)
     PT_ASSERT(sl_size(&sl) == 0);
 END(shift)
 
+TEST(seed)
+    sl_skiplist other;
+    sl_node *a, *b;
+    char udata = 0;
+    int i;
+    /* The built-in generator leaves rand_udata alone, whatever it is. */
+    sl_init(&other, int_cmp, NULL, NULL, &udata);
+    sl_seed(&other, 1234);
+    sl_seed(&sl, 1234);
+    for (i = 0; i < 100; ++i) {
+        sl_insert(&sl, i, i, NULL);
+        sl_insert(&other, i, i, NULL);
+    }
+    for (a = sl.head->next[0], b = other.head->next[0]; a && b; a = a->next[0], b = b->next[0])
+        PT_ASSERT(a->height == b->height);
+    PT_ASSERT(a == NULL && b == NULL);
+    PT_ASSERT(sl.highest == other.highest);
+    sl_free(&other);
+END(seed)
+
+TEST(many)
+    int i, k, v, prev, cnt;
+    char present[512];
+    memset(present, 0, sizeof present);
+    for (i = 0; i < 4000; ++i) {
+        k = (i * 7919) % 512;
+        if (i % 3 == 2) {
+            PT_ASSERT(sl_remove(&sl, k, NULL) == present[k]);
+            present[k] = 0;
+        }
+        else {
+            PT_ASSERT(sl_insert(&sl, k, k * 2, NULL) == present[k]);
+            present[k] = 1;
+        }
+    }
+    for (k = 0, cnt = 0; k < 512; ++k) {
+        PT_ASSERT(sl_find(&sl, k, &v) == present[k]);
+        if (present[k]) {
+            PT_ASSERT(v == k * 2);
+            ++cnt;
+        }
+    }
+    PT_ASSERT(sl_size(&sl) == (unsigned long)cnt);
+    for (prev = -1; sl_pop(&sl, &k, &v); prev = k)
+        PT_ASSERT(k > prev && present[k]);
+    PT_ASSERT(sl_size(&sl) == 0);
+    PT_ASSERT(sl_find(&sl, prev, NULL) == 0);
+END(many)
+
+TEST(shift_many)
+    int i, k, v;
+    for (i = 0; i < 300; ++i)
+        sl_insert(&sl, (i * 37) % 300, i, NULL);
+    for (i = 299; i >= 150; --i) {
+        PT_ASSERT(sl_shift(&sl, &k, &v) == 1);
+        PT_ASSERT(k == i);
+        PT_ASSERT(sl_find(&sl, i, NULL) == 0);
+        PT_ASSERT(sl_max(&sl, &k, NULL) == 1);
+        PT_ASSERT(k == i - 1);
+    }
+    sl_insert(&sl, 1000, 1, NULL);
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 1000);
+    PT_ASSERT(sl_remove(&sl, 1000, NULL) == 1);
+    PT_ASSERT(sl_max(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 149);
+    for (i = 0; i < 150; ++i) {
+        PT_ASSERT(sl_find(&sl, i, NULL) == 1);
+        PT_ASSERT(sl_pop(&sl, &k, NULL) == 1);
+        PT_ASSERT(k == i);
+    }
+    PT_ASSERT(sl_max(&sl, &k, &v) == 0);
+END(shift_many)
+
+/* An in-memory stream that hands out reads in small pieces. */
+struct stream {
+    unsigned char data[1 << 16];
+    size_t len, pos;
+    /* Strings made by load_str, freed by the test */
+    char *held[16];
+    int nheld;
+};
+
+size_t stream_write(const void *p, size_t len, void *udata) {
+    struct stream *s = (struct stream *)udata;
+    if (len > sizeof s->data - s->len)
+        len = sizeof s->data - s->len;
+    memcpy(s->data + s->len, p, len);
+    s->len += len;
+    return len;
+}
+
+size_t stream_read(void *p, size_t len, void *udata) {
+    struct stream *s = (struct stream *)udata;
+    if (len > 1000)
+        len = 1000;
+    if (len > s->len - s->pos)
+        len = s->len - s->pos;
+    memcpy(p, s->data + s->pos, len);
+    s->pos += len;
+    return len;
+}
+
+TEST(serialize)
+    static struct stream s;
+    sl_skiplist other;
+    int i, k, v;
+    size_t len, pad = (sizeof(size_t) * 8 + 6) / 7;
+    s.len = s.pos = 0;
+    sl_init(&other, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 1000; ++i)
+        sl_insert(&sl, (i * 7) % 1000 * 2, i, NULL);
+    PT_ASSERT(sl_serialize(&sl, stream_write, &s) == 0);
+    PT_ASSERT(sl_serialize(&other, stream_write, &s) == 0);
+    len = s.len;
+    sl_insert(&other, 5000, 1, NULL);
+    PT_ASSERT(sl_serialize(&other, stream_write, &s) == 0);
+
+    /* Lists read back one after another from a shared stream. */
+    sl_pop(&other, NULL, NULL);
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 0);
+    PT_ASSERT(sl_size(&other) == 1000);
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 0);
+    PT_ASSERT(sl_size(&other) == 1000);
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 0);
+    PT_ASSERT(s.pos == s.len);
+    PT_ASSERT(sl_size(&other) == 1001);
+    for (i = 0; i < 2000; ++i) {
+        PT_ASSERT(sl_find(&other, i, &v) == !(i & 1));
+        if (!(i & 1))
+            PT_ASSERT(v == (i / 2) * 143 % 1000);
+    }
+    PT_ASSERT(sl_max(&other, &k, NULL) == 1 && k == 5000);
+    PT_ASSERT(sl_shift(&other, &k, NULL) == 1 && k == 5000);
+    PT_ASSERT(sl_max(&other, &k, NULL) == 1 && k == 1998);
+
+    /* Keys that do not follow the list's are rejected. */
+    s.pos = 0;
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 1);
+    PT_ASSERT(sl_size(&other) == 1000);
+
+    /* So is a stream cut short, keeping the pairs before the cut. */
+    sl_free(&other);
+    sl_init(&other, int_cmp, NULL, NULL, NULL);
+    s.pos = 0;
+    s.len = len / 2;
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 1);
+    PT_ASSERT(sl_size(&other) > 0 && sl_size(&other) < 1000);
+    PT_ASSERT(sl_max(&other, &k, NULL) == 1 && k == (int)sl_size(&other) * 2 - 2);
+    s.pos = 1;
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 1);
+
+    /* A count padded out to as many bytes as a size_t can take reads
+       back, unless its last byte has bits beyond those of a size_t. */
+    sl_free(&other);
+    sl_init(&other, int_cmp, NULL, NULL, NULL);
+    sl_insert(&other, 7, 7, NULL);
+    s.len = s.pos = 0;
+    PT_ASSERT(sl_serialize(&other, stream_write, &s) == 0);
+    PT_ASSERT(s.data[4] == 1);
+    memmove(s.data + 4 + pad, s.data + 5, s.len - 5);
+    memset(s.data + 4, 0x80, pad - 1);
+    s.data[4] = 0x81;
+    s.data[3 + pad] = 0x00;
+    s.len += pad - 1;
+    sl_pop(&other, NULL, NULL);
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 0);
+    PT_ASSERT(sl_size(&other) == 1);
+    sl_pop(&other, NULL, NULL);
+    s.data[3 + pad] = (unsigned char)(1 << (sizeof(size_t) * 8 - 7 * (pad - 1)));
+    s.pos = 0;
+    PT_ASSERT(sl_deserialize(&other, stream_read, &s) == 1);
+    PT_ASSERT(sl_size(&other) == 0);
+    sl_free(&other);
+END(serialize)
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slp_
+#define SKIPLIST_POOL
+#define SKIPLIST_POOL_SLAB 8
+#include "../skiplist.h"
+#undef SKIPLIST_POOL
+
+static unsigned long count_slabs(slp_skiplist *list) {
+    unsigned long n = 0;
+    void *slab;
+    for (slab = list->pool->slabs; slab; slab = *(void **)slab)
+        ++n;
+    return n;
+}
+
+void test_pool(void) {
+    slp_skiplist sl;
+    unsigned long slabs;
+    int i, k, v;
+    slp_init(&sl, int_cmp, NULL, NULL, NULL);
+    slp_seed(&sl, 42);
+    for (i = 0; i < 200; ++i)
+        PT_ASSERT(slp_insert(&sl, (i * 13) % 200, i, NULL) == 0);
+    PT_ASSERT(slp_insert(&sl, 5, 5, &v) == 1);
+    slabs = count_slabs(&sl);
+    for (i = 0; i < 200; ++i)
+        PT_ASSERT(slp_remove(&sl, i, NULL) == 1);
+    /* Same seed, same heights, so every node comes off a free list. */
+    slp_seed(&sl, 42);
+    for (i = 0; i < 200; ++i)
+        PT_ASSERT(slp_insert(&sl, 1000 + i, i, NULL) == 0);
+    PT_ASSERT(count_slabs(&sl) == slabs);
+    PT_ASSERT(slp_size(&sl) == 200);
+    for (i = 0; i < 100; ++i) {
+        PT_ASSERT(slp_find(&sl, 1000 + i, &v) == 1);
+        PT_ASSERT(v == i);
+        PT_ASSERT(slp_shift(&sl, &k, &v) == 1);
+        PT_ASSERT(k == 1199 - i);
+    }
+    slp_free(&sl);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE sli_
+#define SKIPLIST_INDEXED
+#define SKIPLIST_POOL
+#include "../skiplist.h"
+#undef SKIPLIST_POOL
+#undef SKIPLIST_INDEXED
+
+/* Checks every width against a plain walk of level 0. */
+static int check_widths(sli_skiplist *list) {
+    sli_node *n, *m;
+    unsigned long pos, steps;
+    unsigned int i;
+    for (i = 0; i < list->highest; ++i) {
+        for (n = list->head, pos = 0; n; n = n->next[i]) {
+            for (m = n, steps = 0; m && m != n->next[i]; m = m->next[0])
+                ++steps;
+            if (!n->next[i])
+                steps = list->size + 1 - pos;
+            if (((unsigned long *)(n->next + n->height))[i] != steps)
+                return 0;
+            pos += steps;
+        }
+    }
+    return 1;
+}
+
+void test_indexed(void) {
+    sli_skiplist sl;
+    unsigned long r;
+    int i, k, v;
+    sli_init(&sl, int_cmp, NULL, NULL, NULL);
+    PT_ASSERT(sli_at(&sl, 0, &k, &v) == 0);
+    PT_ASSERT(sli_remove_at(&sl, 0, &k, &v) == 0);
+    PT_ASSERT(sli_rank(&sl, 5, &r) == 0);
+    PT_ASSERT(r == 0);
+
+    for (i = 0; i < 500; ++i)
+        sli_insert(&sl, (i * 7) % 500 * 2, i, NULL);
+    PT_ASSERT(check_widths(&sl));
+    for (i = 0; i < 500; ++i) {
+        PT_ASSERT(sli_at(&sl, i, &k, NULL) == 1);
+        PT_ASSERT(k == i * 2);
+        PT_ASSERT(sli_rank(&sl, i * 2, &r) == 1);
+        PT_ASSERT(r == (unsigned long)i);
+        PT_ASSERT(sli_rank(&sl, i * 2 + 1, &r) == 0);
+        PT_ASSERT(r == (unsigned long)i + 1);
+    }
+    PT_ASSERT(sli_at(&sl, 500, &k, NULL) == 0);
+
+    /* Remove every third key by position, then the ends */
+    for (i = 0; i < 100; ++i) {
+        PT_ASSERT(sli_remove_at(&sl, i * 2, &k, NULL) == 1);
+        PT_ASSERT(k == i * 6);
+    }
+    PT_ASSERT(check_widths(&sl));
+    PT_ASSERT(sli_remove(&sl, 2, NULL) == 1);
+    PT_ASSERT(sli_pop(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 4);
+    PT_ASSERT(sli_shift(&sl, &k, NULL) == 1);
+    PT_ASSERT(k == 998);
+    PT_ASSERT(sli_size(&sl) == 397);
+    PT_ASSERT(check_widths(&sl));
+    PT_ASSERT(sli_at(&sl, 0, &k, NULL) == 1);
+    PT_ASSERT(k == 8);
+    PT_ASSERT(sli_at(&sl, 396, &k, NULL) == 1);
+    PT_ASSERT(k == 996);
+    while (sli_size(&sl) > 0)
+        PT_ASSERT(sli_remove_at(&sl, sli_size(&sl) / 2, NULL, NULL) == 1);
+    PT_ASSERT(sl.highest == 0);
+    sli_free(&sl);
+}
+
+void test_indexed_build(void) {
+    sli_skiplist sl;
+    int keys[1000], i, k;
+    sli_init(&sl, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 1000; ++i)
+        keys[i] = i;
+    for (i = 0; i < 500; ++i)
+        sli_insert(&sl, i, i, NULL);
+    PT_ASSERT(sli_build_sorted(&sl, keys + 500, keys + 500, 500) == 0);
+    PT_ASSERT(check_widths(&sl));
+    PT_ASSERT(sli_size(&sl) == 1000);
+    for (i = 0; i < 1000; i += 7) {
+        PT_ASSERT(sli_at(&sl, i, &k, NULL) == 1);
+        PT_ASSERT(k == i);
+    }
+    sli_free(&sl);
+    sli_init(&sl, int_cmp, NULL, NULL, NULL);
+    PT_ASSERT(sli_build_sorted(&sl, keys, keys, 1000) == 0);
+    PT_ASSERT(check_widths(&sl));
+    PT_ASSERT(sl.highest == 10);
+    for (i = 0; i < 1000; i += 3)
+        PT_ASSERT(sli_remove(&sl, i, NULL) == 1);
+    PT_ASSERT(check_widths(&sl));
+    sli_free(&sl);
+}
+
+void test_indexed_split(void) {
+    sli_skiplist sl, other;
+    int i, k;
+    sli_init(&sl, int_cmp, NULL, NULL, NULL);
+    sli_init(&other, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 1000; ++i)
+        sli_insert(&sl, i, i, NULL);
+    PT_ASSERT(sli_erase_range(&sl, 100, 300) == 200);
+    PT_ASSERT(check_widths(&sl));
+    PT_ASSERT(sli_at(&sl, 100, &k, NULL) == 1 && k == 300);
+    PT_ASSERT(sli_split(&sl, 600, &other) == 400);
+    PT_ASSERT(check_widths(&sl) && check_widths(&other));
+    PT_ASSERT(sli_size(&sl) == 400);
+    PT_ASSERT(sli_at(&sl, 399, &k, NULL) == 1 && k == 599);
+    PT_ASSERT(sli_at(&other, 0, &k, NULL) == 1 && k == 600);
+    PT_ASSERT(sli_erase_range(&other, 900, 2000) == 100);
+    PT_ASSERT(check_widths(&other));
+    PT_ASSERT(sli_insert(&other, 950, 0, NULL) == 0);
+    PT_ASSERT(check_widths(&other));
+    PT_ASSERT(sli_at(&other, 300, &k, NULL) == 1 && k == 950);
+    sli_free(&sl);
+    sli_free(&other);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slcv_
+#undef SKIPLIST_VALUE
+#define SKIPLIST_VALUE long double
+#define SKIPLIST_COLD_VALUES
+#define SKIPLIST_INDEXED
+#define SKIPLIST_POOL
+#include "../skiplist.h"
+#undef SKIPLIST_POOL
+#undef SKIPLIST_INDEXED
+#undef SKIPLIST_COLD_VALUES
+#undef SKIPLIST_VALUE
+#define SKIPLIST_VALUE int
+
+static int sum_cold(int key, long double val, void *udata) {
+    (void)key;
+    *(long double *)udata += val;
+    return 0;
+}
+
+void test_cold_values(void) {
+    slcv_skiplist a, b;
+    int keys[50], k, i;
+    long double vals[50], v, sum = 0;
+    slcv_cursor cur;
+    slcv_init(&a, int_cmp, NULL, NULL, NULL);
+    slcv_init(&b, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 50; ++i) {
+        keys[i] = i * 2;
+        vals[i] = i * 0.5L;
+    }
+    PT_ASSERT(slcv_build_sorted(&a, keys, vals, 50) == 0);
+    for (i = 0; i < 50; ++i)
+        PT_ASSERT(slcv_insert(&b, i * 2 + 1, -i * 0.25L, NULL) == 0);
+    PT_ASSERT(slcv_insert(&b, 4, 100.0L, &v) == 0);
+    slcv_merge(&a, &b);
+    PT_ASSERT(slcv_size(&a) == 100);
+    PT_ASSERT(slcv_find(&a, 4, &v) == 1 && v == 100.0L);
+    PT_ASSERT(slcv_find(&a, 7, &v) == 1 && v == -0.75L);
+    PT_ASSERT(slcv_at(&a, 10, &k, &v) == 1 && k == 10 && v == 2.5L);
+    PT_ASSERT(slcv_insert(&a, 10, 9.0L, &v) == 1 && v == 2.5L);
+    PT_ASSERT(slcv_cursor_seek(&a, &cur, 10) == 1);
+    PT_ASSERT(slcv_cursor_get(&cur, &k, &v) == 1 && k == 10 && v == 9.0L);
+    PT_ASSERT(slcv_remove(&a, 7, &v) == 1 && v == -0.75L);
+    PT_ASSERT(slcv_pop(&a, &k, &v) == 1 && k == 0 && v == 0.0L);
+    PT_ASSERT(slcv_shift(&a, &k, &v) == 1 && k == 99 && v == -12.25L);
+    slcv_iter(&a, sum_cold, &sum);
+    for (i = 0, v = 0; i < 100; ++i) {
+        if (i == 0 || i == 7 || i == 99)
+            continue;
+        v += i == 4 ? 100.0L : i == 10 ? 9.0L : i % 2 ? -(i / 2) * 0.25L : (i / 2) * 0.5L;
+    }
+    PT_ASSERT(sum == v);
+    slcv_free(&b);
+    slcv_free(&a);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slc_
+#define SKIPLIST_CMP(a, b, udata) (((a) > (b)) - ((a) < (b)))
+#include "../skiplist.h"
+#undef SKIPLIST_CMP
+
+void test_cmp_macro(void) {
+    slc_skiplist sl;
+    int i, v;
+    slc_init(&sl, NULL, NULL, NULL, NULL);
+    for (i = 0; i < 100; ++i)
+        PT_ASSERT(slc_insert(&sl, (i * 31) % 100 - 50, i, NULL) == 0);
+    for (i = 0; i < 100; ++i) {
+        PT_ASSERT(slc_find(&sl, (i * 31) % 100 - 50, &v) == 1);
+        PT_ASSERT(v == i);
+    }
+    PT_ASSERT(slc_find(&sl, 50, NULL) == 0);
+    PT_ASSERT(slc_remove(&sl, -50, NULL) == 1);
+    PT_ASSERT(slc_pop(&sl, &v, NULL) == 1);
+    PT_ASSERT(v == -49);
+    slc_free(&sl);
+}
+
+void test_indexed_merge(void) {
+    sli_skiplist a, b, c;
+    int keys[100], i, k;
+    sli_init(&a, int_cmp, NULL, NULL, NULL);
+    sli_init(&b, int_cmp, NULL, NULL, NULL);
+    sli_init(&c, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 100; ++i) {
+        keys[i] = i * 5;
+        sli_insert(&a, i * 2, i, NULL);
+        sli_insert(&c, i * 7, i, NULL);
+    }
+    PT_ASSERT(sli_insert_sorted_batch(&b, keys, keys, 100, NULL, NULL) == 100);
+    PT_ASSERT(check_widths(&b));
+    sli_merge(&a, &b);
+    sli_merge(&c, &a);
+    PT_ASSERT(check_widths(&c));
+    PT_ASSERT(sli_size(&a) == 0 && sli_size(&b) == 0);
+    /* Merged lists share a pool; freeing them in any order is fine. */
+    sli_free(&b);
+    for (i = 0; i < 100; ++i)
+        sli_insert(&a, i, i, NULL);
+    PT_ASSERT(sli_size(&c) == 100 + 100 + 100 - 20 - 15 - 15 + 3);
+    PT_ASSERT(sli_rank(&c, 490, NULL) == 1);
+    PT_ASSERT(sli_at(&c, sli_size(&c) - 1, &k, NULL) == 1 && k == 693);
+    sli_free(&c);
+    PT_ASSERT(check_widths(&a));
+    sli_free(&a);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slf_
+#define SKIPLIST_FAT_NODES 4
+#define SKIPLIST_POOL
+#include "../skiplist.h"
+#undef SKIPLIST_POOL
+#undef SKIPLIST_FAT_NODES
+
+/* Every node is non-empty and sorted, first keys increase on every level,
+   prev links match and the pairs add up to the size. */
+static int check_fat(slf_skiplist *list) {
+    slf_node *n, *prev = NULL;
+    unsigned long total = 0;
+    unsigned int i, j;
+    for (n = list->head->next[0]; n; prev = n, n = n->next[0]) {
+        if (n->count == 0 || n->prev != prev)
+            return 0;
+        for (j = 1; j < n->count; ++j) {
+            if (n->keys[j - 1] >= n->keys[j])
+                return 0;
+        }
+        if (n->next[0] && n->keys[n->count - 1] >= n->next[0]->keys[0])
+            return 0;
+        total += n->count;
+    }
+    for (i = 1; i < list->highest; ++i) {
+        for (n = list->head->next[i]; n && n->next[i]; n = n->next[i]) {
+            if (n->keys[0] >= n->next[i]->keys[0])
+                return 0;
+        }
+    }
+    return list->tail == prev && total == list->size;
+}
+
+void test_fat_nodes(void) {
+    slf_skiplist sl;
+    slf_cursor cur;
+    slf_node *n;
+    char has[1000] = { 0 };
+    unsigned int rng = 2463534242u;
+    unsigned long nodes = 0;
+    int i, k, v, last, ok = 1;
+
+    slf_init(&sl, int_cmp, NULL, NULL, NULL);
+    /* Ascending inserts fill every node but the last. */
+    for (i = 0; i < 100; ++i)
+        PT_ASSERT(slf_insert(&sl, i * 10, -i * 10, NULL) == 0);
+    for (n = sl.head->next[0]; n; n = n->next[0])
+        ++nodes;
+    PT_ASSERT(nodes == 25);
+    for (i = 0; i < 100; ++i)
+        has[i * 10] = 1;
+
+    for (i = 0; i < 20000; ++i) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        k = rng % 1000;
+        if ((rng >> 16) % 3) {
+            if (slf_insert(&sl, k, -k, NULL) != has[k])
+                ok = 0;
+            has[k] = 1;
+        }
+        else {
+            if (slf_remove(&sl, k, &v) != has[k] || (has[k] && v != -k))
+                ok = 0;
+            has[k] = 0;
+        }
+    }
+    PT_ASSERT(ok);
+    PT_ASSERT(check_fat(&sl));
+
+    last = -1;
+    if (slf_cursor_first(&sl, &cur)) {
+        do {
+            slf_cursor_get(&cur, &k, &v);
+            while (++last < k)
+                ok &= !has[last];
+            ok &= has[k] && v == -k;
+        } while (slf_cursor_next(&cur));
+    }
+    while (++last < 1000)
+        ok &= !has[last];
+    PT_ASSERT(ok);
+    for (k = 0; k < 1000; ++k) {
+        ok &= slf_find(&sl, k, &v) == has[k] && (!has[k] || v == -k);
+        if (slf_lower_bound(&sl, k, &v, NULL)) {
+            ok &= v >= k && has[v];
+            for (last = k; last < v; ++last)
+                ok &= !has[last];
+        }
+        if (slf_upper_bound(&sl, k, &v, NULL))
+            ok &= v > k && has[v] && slf_cursor_seek(&sl, &cur, k + 1) && cur.node->keys[cur.index] == v;
+    }
+    PT_ASSERT(ok);
+
+    PT_ASSERT(slf_cursor_last(&sl, &cur));
+    slf_cursor_get(&cur, &last, NULL);
+    while (slf_cursor_prev(&cur)) {
+        slf_cursor_get(&cur, &k, NULL);
+        ok &= k < last;
+        last = k;
+    }
+    PT_ASSERT(ok);
+
+    while (slf_size(&sl) > 0) {
+        PT_ASSERT(slf_max(&sl, &last, NULL) == 1);
+        PT_ASSERT(slf_shift(&sl, &k, &v) == 1);
+        PT_ASSERT(k == last && v == -k);
+        if (slf_pop(&sl, &k, NULL))
+            PT_ASSERT(has[k] && k < last);
+    }
+    PT_ASSERT(check_fat(&sl));
+    PT_ASSERT(slf_min(&sl, NULL, NULL) == 0);
+    PT_ASSERT(sl.highest == 0);
+    slf_free(&sl);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slv_
+#define SKIPLIST_FAT_NODES 8
+#define SKIPLIST_INT_KEYS
+#include "../skiplist.h"
+
+#undef SKIPLIST_KEY
+#define SKIPLIST_KEY uint64_t
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slu_
+#include "../skiplist.h"
+#undef SKIPLIST_INT_KEYS
+#undef SKIPLIST_FAT_NODES
+
+/* Slot s holds key base + 3 * (s - 256). Probing one below, at and one
+   above every slot covers each position a search can end in, and the
+   keys straddle zero (or the top bit, for unsigned keys). */
+#define INT_KEYS_TEST(ns, type, base) \
+void test_int_keys_ ## ns(void) { \
+    ns ## skiplist sl; \
+    char has[512] = { 0 }; \
+    unsigned int rng = 2463534242u; \
+    int i, s, t, d, ok = 1; \
+    type key, k; \
+    ns ## init(&sl, NULL, NULL, NULL, NULL); \
+    for (i = 0; i < 5000; ++i) { \
+        rng ^= rng << 13; \
+        rng ^= rng >> 17; \
+        rng ^= rng << 5; \
+        s = rng % 512; \
+        key = (type)(base) + (type)3 * (type)s - (type)768; \
+        if ((rng >> 16) % 3) { \
+            ok &= ns ## insert(&sl, key, s, NULL) == has[s]; \
+            has[s] = 1; \
+        } \
+        else { \
+            ok &= ns ## remove(&sl, key, NULL) == has[s]; \
+            has[s] = 0; \
+        } \
+    } \
+    PT_ASSERT(ok); \
+    for (s = 0; s < 512; ++s) { \
+        for (d = -1; d <= 1; ++d) { \
+            key = (type)(base) + (type)3 * (type)s - (type)768 + (type)d; \
+            ok &= ns ## find(&sl, key, &t) == (d == 0 && has[s]) && (d || !has[s] || t == s); \
+            for (t = d > 0 ? s + 1 : s; t < 512 && !has[t]; ++t) \
+                ; \
+            ok &= ns ## lower_bound(&sl, key, &k, NULL) == (t < 512) && (t == 512 || k == (type)(base) + (type)3 * (type)t - (type)768); \
+            for (t = d >= 0 ? s + 1 : s; t < 512 && !has[t]; ++t) \
+                ; \
+            ok &= ns ## upper_bound(&sl, key, &k, NULL) == (t < 512) && (t == 512 || k == (type)(base) + (type)3 * (type)t - (type)768); \
+        } \
+    } \
+    PT_ASSERT(ok); \
+    ns ## free(&sl); \
+}
+
+INT_KEYS_TEST(slv_, int, 0)
+INT_KEYS_TEST(slu_, uint64_t, (uint64_t)1 << 63)
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE sls_
+#undef SKIPLIST_KEY
+#define SKIPLIST_KEY const char *
+#define SKIPLIST_KEY_BYTES(key, len) ((len) = strlen(key), (const void *)(key))
+#define SKIPLIST_KEY_LOAD(key, buf, len, udata) load_str(&(key), (buf), (len), (struct stream *)(udata))
+static int load_str(const char **key, const void *buf, size_t len, struct stream *s);
+#include "../skiplist.h"
+#undef SKIPLIST_KEY_LOAD
+#undef SKIPLIST_KEY_BYTES
+#undef SKIPLIST_KEY
+#define SKIPLIST_KEY int
+
+static int load_str(const char **key, const void *buf, size_t len, struct stream *s) {
+    char *str;
+    if (s->nheld == 16 || !(str = malloc(len + 1)))
+        return 1;
+    memcpy(str, buf, len);
+    str[len] = '\0';
+    *key = s->held[s->nheld++] = str;
+    return 0;
+}
+
+static int str_cmp(const char *a, const char *b, void *udata) {
+    (void)udata;
+    return strcmp(a, b);
+}
+
+void test_serialize_hooks(void) {
+    static struct stream s;
+    static char big[6000];
+    sls_skiplist a, b;
+    const char *k;
+    int i, v;
+    memset(big, 'z', sizeof big - 1);
+    s.len = s.pos = 0;
+    s.nheld = 0;
+    sls_init(&a, str_cmp, NULL, NULL, NULL);
+    sls_init(&b, str_cmp, NULL, NULL, NULL);
+    sls_insert(&a, "pear", 3, NULL);
+    sls_insert(&a, "apple", 1, NULL);
+    sls_insert(&a, "", 0, NULL);
+    sls_insert(&a, big, 4, NULL);
+    sls_insert(&a, "fig", 2, NULL);
+    PT_ASSERT(sls_serialize(&a, stream_write, &s) == 0);
+    /* The big key gets a block of its own, which costs a few bytes. */
+    PT_ASSERT(s.len < sizeof big + 64);
+    PT_ASSERT(sls_deserialize(&b, stream_read, &s) == 0);
+    PT_ASSERT(s.nheld == 5);
+    PT_ASSERT(sls_size(&b) == 5);
+    PT_ASSERT(sls_find(&b, "fig", &v) == 1 && v == 2);
+    PT_ASSERT(sls_find(&b, big, &v) == 1 && v == 4);
+    for (i = 0; sls_pop(&b, &k, &v); ++i)
+        PT_ASSERT(v == i);
+    PT_ASSERT(i == 5);
+    for (i = 0; i < s.nheld; ++i)
+        free(s.held[i]);
+    sls_free(&b);
+    sls_free(&a);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slst_
+#define SKIPLIST_STATS
+#include "../skiplist.h"
+#undef SKIPLIST_STATS
+
+void test_stats(void) {
+    slst_skiplist sl;
+    slst_statistics st;
+    unsigned long nodes = 0, visits = 0;
+    int i;
+    slst_init(&sl, int_cmp, NULL, NULL, NULL);
+    slst_stats(&sl, &st);
+    PT_ASSERT(st.size == 0 && st.highest == 0 && st.avg_path == 0);
+    for (i = 0; i < 1000; ++i)
+        slst_insert(&sl, (i * 7) % 1000, i, NULL);
+    for (i = 0; i < 500; ++i)
+        slst_find(&sl, i, NULL);
+    slst_remove(&sl, 3, NULL);
+    slst_remove(&sl, -1, NULL);
+    slst_pop(&sl, NULL, NULL);
+    slst_shift(&sl, NULL, NULL);
+    slst_stats(&sl, &st);
+    PT_ASSERT(st.inserts == 1000 && st.finds == 500 && st.removes == 2);
+    PT_ASSERT(st.pops == 1 && st.shifts == 1);
+    PT_ASSERT(st.allocs == 1000 && st.frees == 3);
+    PT_ASSERT(st.size == 997 && st.highest == sl.highest);
+    for (i = 0; i < SKIPLIST_MAX_LEVELS; ++i) {
+        nodes += st.heights[i];
+        visits += st.visits[i];
+    }
+    PT_ASSERT(nodes == 997);
+    PT_ASSERT(st.heights[st.highest - 1] > 0);
+    /* About half the nodes are one level high. */
+    PT_ASSERT(st.heights[0] > 400 && st.heights[0] < 600);
+    PT_ASSERT(st.bytes > 997 * sizeof(slst_node));
+    /* One descent per insert, find and remove, and one for the shift */
+    PT_ASSERT(st.searches == 1503);
+    PT_ASSERT(st.avg_path == (double)visits / 1503);
+    PT_ASSERT(st.avg_path > 1 && st.avg_path < 40);
+    PT_ASSERT(st.compares > st.searches);
+    slst_stats_reset(&sl);
+    slst_stats(&sl, &st);
+    PT_ASSERT(st.compares == 0 && st.finds == 0 && st.size == 997);
+    slst_free(&sl);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE sld_
+#define SKIPLIST_MULTI
+#include "../skiplist.h"
+#undef SKIPLIST_MULTI
+
+static int collect(int k, int v, void *udata) {
+    int *out = (int *)udata;
+    (void)k;
+    out[++out[0]] = v;
+    return out[0] == 3;
+}
+
+void test_multi(void) {
+    sld_skiplist sl, other;
+    sld_cursor cur;
+    int keys[] = { 1, 2, 2, 3 }, vals[] = { 10, 20, 21, 30 }, seen[8] = { 0 };
+    int ties[] = { 20, 21, 2, 2 };
+    int i, k, v;
+    sld_init(&sl, int_cmp, NULL, NULL, NULL);
+    sld_init(&other, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 100; ++i)
+        PT_ASSERT(sld_insert(&sl, i % 10, i, &v) == 0);
+    PT_ASSERT(sld_size(&sl) == 100);
+    PT_ASSERT(sld_count(&sl, 3) == 10 && sld_count(&sl, 10) == 0);
+    PT_ASSERT(sld_find(&sl, 3, &v) == 1 && v == 3);
+    PT_ASSERT(sld_equal_range(&sl, &cur, 4) == 10);
+    for (i = 0; i < 10; ++i, sld_cursor_next(&cur))
+        PT_ASSERT(sld_cursor_get(&cur, &k, &v) == 1 && k == 4 && v == 4 + i * 10);
+    PT_ASSERT(sld_cursor_get(&cur, &k, NULL) == 1 && k == 5);
+    PT_ASSERT(sld_find_all(&sl, 7, collect, seen) == 1);
+    PT_ASSERT(seen[0] == 3 && seen[1] == 7 && seen[2] == 17 && seen[3] == 27);
+    /* Ties come off in the order they went in. */
+    for (i = 0; i < 10; ++i)
+        PT_ASSERT(sld_pop(&sl, &k, &v) == 1 && k == 0 && v == i * 10);
+    PT_ASSERT(sld_remove(&sl, 5, &v) == 1 && v == 5);
+    PT_ASSERT(sld_remove_all(&sl, 5) == 9);
+    PT_ASSERT(sld_remove_all(&sl, 5) == 0);
+    PT_ASSERT(sld_find(&sl, 5, NULL) == 0);
+    PT_ASSERT(sld_equal_range(&sl, &cur, 5) == 0);
+    PT_ASSERT(sld_cursor_get(&cur, &k, NULL) == 1 && k == 6);
+    PT_ASSERT(sld_size(&sl) == 80);
+
+    PT_ASSERT(sld_build_sorted(&other, keys, vals, 4) == 0);
+    PT_ASSERT(sld_insert_sorted_batch(&other, keys, keys, 4, NULL, NULL) == 4);
+    PT_ASSERT(sld_count(&other, 2) == 4);
+    PT_ASSERT(sld_equal_range(&other, &cur, 2) == 4);
+    for (i = 0; i < 4; ++i, sld_cursor_next(&cur))
+        PT_ASSERT(sld_cursor_get(&cur, NULL, &v) == 1 && v == ties[i]);
+    sld_merge(&sl, &other);
+    PT_ASSERT(sld_size(&sl) == 88 && sld_count(&sl, 3) == 12);
+
+    /* Equal keys pair up one to one. */
+    for (i = 0; i < 3; ++i)
+        sld_insert(&other, 3, i, NULL);
+    sld_insert(&other, 4, 0, NULL);
+    PT_ASSERT(sld_intersect(&sl, &other, NULL, NULL, NULL) == 4);
+    PT_ASSERT(sld_union(&sl, &other, NULL, NULL, NULL) == 88);
+    PT_ASSERT(sld_difference(&sl, &other, NULL, NULL, NULL) == 84);
+    PT_ASSERT(sld_difference(&other, &sl, NULL, NULL, NULL) == 0);
+    PT_ASSERT(sld_union(&other, &other, &sl, NULL, NULL) == 4);
+    PT_ASSERT(sld_count(&sl, 3) == 15);
+    PT_ASSERT(sld_shift(&sl, &k, &v) == 1 && k == 9 && v == 99);
+    sld_free(&other);
+    sld_free(&sl);
+}
+
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slk_
+#undef SKIPLIST_VALUE
+#include "../skiplist.h"
+#undef SKIPLIST_NAMESPACE
+#define SKIPLIST_NAMESPACE slkf_
+#define SKIPLIST_FAT_NODES 8
+#include "../skiplist.h"
+#undef SKIPLIST_FAT_NODES
+#define SKIPLIST_VALUE int
+
+static int sum_keys(int k, char v, void *udata) {
+    *(int *)udata += k + v;
+    return 0;
+}
+
+void test_set(void) {
+    slk_skiplist sl;
+    slkf_skiplist fat;
+    slk_cursor cur;
+    int i, k, sum = 0;
+    char v = 1;
+    PT_ASSERT(sizeof(slk_node) < sizeof(sl_node));
+    slk_init(&sl, int_cmp, NULL, NULL, NULL);
+    slkf_init(&fat, int_cmp, NULL, NULL, NULL);
+    for (i = 0; i < 300; ++i) {
+        PT_ASSERT(slk_insert(&sl, (i * 7) % 100, 1, NULL) == (i >= 100));
+        PT_ASSERT(slkf_insert(&fat, (i * 7) % 100, 1, NULL) == (i >= 100));
+    }
+    PT_ASSERT(slk_size(&sl) == 100 && slkf_size(&fat) == 100);
+    PT_ASSERT(slk_find(&sl, 42, &v) == 1 && v == 0);
+    PT_ASSERT(slk_find(&sl, 100, NULL) == 0);
+    PT_ASSERT(slkf_find(&fat, 42, NULL) == 1);
+    PT_ASSERT(slk_iter(&sl, sum_keys, &sum) == 0 && sum == 4950);
+    sum = 0;
+    PT_ASSERT(slkf_iter(&fat, sum_keys, &sum) == 0 && sum == 4950);
+    PT_ASSERT(slk_cursor_seek(&sl, &cur, 50) == 1);
+    PT_ASSERT(slk_cursor_get(&cur, &k, NULL) == 1 && k == 50);
+    for (i = 0; i < 50; ++i) {
+        PT_ASSERT(slk_remove(&sl, i * 2, NULL) == 1);
+        PT_ASSERT(slkf_remove(&fat, i * 2, NULL) == 1);
+    }
+    PT_ASSERT(slk_pop(&sl, &k, NULL) == 1 && k == 1);
+    PT_ASSERT(slkf_shift(&fat, &k, NULL) == 1 && k == 99);
+    slkf_free(&fat);
+    slk_free(&sl);
+}
+
 void suite_skiplist(void) {
     pt_add_test(test_insert, "Should insert key/value pairs", "skiplist");
     pt_add_test(test_find, "Should find values that exist", "skiplist");
@@ -212,14 +1419,47 @@ void suite_skiplist(void) {
     pt_add_test(test_size, "Should keep track of its size", "skiplist");
     pt_add_test(test_iter, "Should iterate over keys in order", "skiplist");
     pt_add_test(test_iter_stop, "Should be able to stop iteration from the callback", "skiplist");
+    pt_add_test(test_iter_range, "Should iterate over a range of keys", "skiplist");
+    pt_add_test(test_bounds, "Should find lower and upper bounds", "skiplist");
+    pt_add_test(test_cursor, "Should walk the list with cursors", "skiplist");
+    pt_add_test(test_build_sorted, "Should build from sorted arrays", "skiplist");
+    pt_add_test(test_find_many, "Should find many keys at once", "skiplist");
+    pt_add_test(test_insert_sorted_batch, "Should insert batches of keys", "skiplist");
+    pt_add_test(test_merge, "Should merge two lists", "skiplist");
+    pt_add_test(test_erase_range, "Should erase a range of keys", "skiplist");
+    pt_add_test(test_split, "Should split a list in two", "skiplist");
+    pt_add_test(test_set_algebra, "Should intersect, unite and subtract lists", "skiplist");
     pt_add_test(test_remove, "Should be able to remove items", "skiplist");
     pt_add_test(test_min, "Should find the minimum key", "skiplist");
     pt_add_test(test_max, "Should find the maximum key", "skiplist");
     pt_add_test(test_pop, "Should remove the minimum key", "skiplist");
     pt_add_test(test_shift, "Should remove the maximum key", "skiplist");
+    pt_add_test(test_shift_many, "Should keep the maximum up to date", "skiplist");
+    pt_add_test(test_serialize, "Should serialize and load back lists", "skiplist");
+    pt_add_test(test_serialize_hooks, "Should serialize keys through hooks", "skiplist");
+    pt_add_test(test_stats, "Should count operations and report its shape", "skiplist");
+    pt_add_test(test_multi, "Should keep equal keys in insertion order", "skiplist");
+    pt_add_test(test_set, "Should store keys alone when SKIPLIST_VALUE is left out", "skiplist");
+    pt_add_test(test_seed, "Should give the same heights for the same seed", "skiplist");
+    pt_add_test(test_many, "Should stay consistent across many inserts and removes", "skiplist");
+    pt_add_test(test_indexed, "Should index keys by position", "skiplist");
+    pt_add_test(test_indexed_build, "Should keep widths when building from sorted arrays", "skiplist");
+    pt_add_test(test_indexed_merge, "Should keep widths when merging", "skiplist");
+    pt_add_test(test_indexed_split, "Should keep widths when erasing ranges and splitting", "skiplist");
+    pt_add_test(test_cmp_macro, "Should order nodes with SKIPLIST_CMP", "skiplist");
+    pt_add_test(test_cold_values, "Should keep values after the links", "skiplist");
+    pt_add_test(test_pool, "Should recycle nodes when pooled", "skiplist");
+    pt_add_test(test_fat_nodes, "Should split and merge fat nodes", "skiplist");
+    pt_add_test(test_int_keys_slv_, "Should search fat nodes of signed integer keys", "skiplist");
+    pt_add_test(test_int_keys_slu_, "Should search fat nodes of unsigned integer keys", "skiplist");
 }
 
+void suite_concurrent(void);
+void suite_persist(void);
+
 int main(int argc, const char **argv) {
     pt_add_suite(suite_skiplist);
+    pt_add_suite(suite_concurrent);
+    pt_add_suite(suite_persist);
     return pt_run();
 }